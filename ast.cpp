@@ -3,6 +3,7 @@
 #include "llvm/IR/Module.h"
 #include "llvm/IR/IRBuilder.h"
 #include "llvm/Support/raw_ostream.h"
+#include "llvm/Support/raw_os_ostream.h"
 #include "llvm/IR/DerivedTypes.h"
 #include "llvm/Bitcode/BitcodeWriter.h"
 #include "llvm/Support/FileSystem.h"
@@ -10,36 +11,262 @@
 #include <vector>
 #include <fstream>
 #include <map>
+#include <unordered_map>
+#include <algorithm>
 #include "llvm/Transforms/Utils/IntegerDivision.h"
 #include "llvm/IR/Function.h"
 #include "llvm/IR/Instructions.h"
 #include "llvm/IR/Intrinsics.h"
 #include <utility>
+#include <cstddef>
+#include <cstring>
+#include <thread>
+#include <atomic>
+#include "llvm/Bitcode/BitcodeReader.h"
+#include "llvm/Linker/Linker.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Error.h"
+#include "llvm/Pass.h"
+#include "llvm/IR/LegacyPassManager.h"
+#include "llvm/IR/PassTimingInfo.h"
+#include "llvm/Transforms/IPO.h"
+#include "llvm/Transforms/IPO/AlwaysInliner.h"
+#include "llvm/Transforms/IPO/PassManagerBuilder.h"
+#include "llvm/Transforms/InstCombine/InstCombine.h"
+#include "llvm/Transforms/Scalar.h"
+#include "llvm/Transforms/Scalar/GVN.h"
+#include "llvm/Transforms/Utils.h"
+#include "llvm/Analysis/TargetTransformInfo.h"
+#include "llvm/Support/Host.h"
+#include "llvm/Support/TargetRegistry.h"
+#include "llvm/Support/TargetSelect.h"
+#include "llvm/MC/SubtargetFeature.h"
+#include "llvm/Target/TargetMachine.h"
+#include "llvm/Target/TargetOptions.h"
+#include "llvm/ExecutionEngine/Orc/LLJIT.h"
+#include "llvm/ExecutionEngine/Orc/ThreadSafeModule.h"
+#include <mutex>
+#include <chrono>
 using namespace ast;
 
 namespace ast {
-Program *prog = new Program();
+static thread_local Arena *curr_arena = NULL;
+
+Arena *Arena::current() {
+  if (curr_arena == NULL) {
+    // fallback for nodes created outside of any compilation
+    static thread_local Arena default_arena;
+    return &default_arena;
+  }
+  return curr_arena;
+}
+
+void Arena::setCurrent(Arena *a) { curr_arena = a;}
+
+void *Arena::allocate(size_t size, size_t align) {
+  if (size > block_size / 4) {
+    // big requests get a block of their own, keep bumping in the current one
+    char *big = static_cast<char *>(::operator new(size));
+    blocks.push_back(big);
+    return big;
+  }
+  if (curr != NULL)
+    curr = reinterpret_cast<char *>(
+             (reinterpret_cast<uintptr_t>(curr) + align - 1) & ~(uintptr_t)(align - 1));
+  if (curr == NULL || curr + size > end) {
+    curr = static_cast<char *>(::operator new(block_size));
+    end = curr + block_size;
+    blocks.push_back(curr);
+  }
+  void *ret = curr;
+  curr += size;
+  return ret;
+}
+
+StringRef Arena::copyString(StringRef s) {
+  if (s.empty()) return StringRef();
+  char *copy = static_cast<char *>(allocate(s.size(), 1));
+  memcpy(copy, s.data(), s.size());
+  return StringRef(copy, s.size());
+}
+
+void Arena::release() {
+  for (int i = nodes.size()-1; i >= 0; --i)
+    nodes[i]->~Node();
+  nodes.clear();
+  vector<Node *>().swap(nodes);
+  int size = blocks.size();
+  for (int i=0; i<size; ++i)
+    ::operator delete(blocks[i]);
+  vector<char *>().swap(blocks);
+  curr = end = NULL;
+}
+
 // Function that prints the abstract syntax tree
 void printAST(Node *n) {
   cout << "\n";
-  cout << n->getDebugStr() << endl << endl;
+  n->print(cout);
+  cout << "\n\n";
+}
+
+// codegen state is per thread so that functions can be generated in parallel,
+// every worker owns its context, module and builder. All three are made
+// fresh for each module (createModule) and freed with it (releaseLLVMIr),
+// types and constants interned in a context never pile up over a batch.
+thread_local llvm::LLVMContext *context;
+thread_local llvm::Module* module;
+thread_local llvm::IRBuilder<> *builder;
+thread_local int gvar_count = 105;
+// functions, parameters and locals by interned name, blocks open scopes
+thread_local ScopedSymbolTable<llvm::Value *> symbol_to_llvm;
+thread_local llvm::Function *curr_fxn;
+thread_local map<llvm::BasicBlock*, bool> created_bb;
+
+// Hash-consing of pure expressions (constants, variables, Arithmatic, Bitwise,
+// Comparision): structurally equal trees get the same number, wherever they
+// are in the AST. expr_reads holds the variables each number depends on.
+struct ExprKey {
+  unsigned char kind, op;
+  uint32_t a, b;
+  bool operator==(const ExprKey &o) const {
+    return kind == o.kind && op == o.op && a == o.a && b == o.b;
+  }
+};
+struct ExprKeyHash {
+  size_t operator()(const ExprKey &k) const {
+    uint64_t h = ((uint64_t)k.kind << 8 | k.op) * 0x9E3779B97F4A7C15ull;
+    h = (h ^ k.a) * 0x9E3779B97F4A7C15ull;
+    return (size_t)((h ^ k.b) * 0x9E3779B97F4A7C15ull);
+  }
+};
+const uint32_t NOT_PURE = 0xffffffffu;
+thread_local unordered_map<ExprKey, uint32_t, ExprKeyHash> expr_numbers;
+thread_local unordered_map<Node *, uint32_t> node_numbers;
+thread_local vector<vector<Symbol> > expr_reads;
+
+// values of numbered expressions already computed in cse_block
+thread_local llvm::BasicBlock *cse_block;
+thread_local unordered_map<uint32_t, llvm::Value *> cse_values;
+
+void resetExprTables() {
+  expr_numbers.clear();
+  node_numbers.clear();
+  expr_reads.clear();
+  cse_block = NULL;
+  cse_values.clear();
+}
+
+// forget everything the last module was generated with, the tables point
+// into it and into the AST
+static void resetCodegenState() {
+  symbol_to_llvm.clear();
+  created_bb.clear();
+  resetExprTables();
+  curr_fxn = NULL;
+  if (builder != NULL)
+    builder->ClearInsertionPoint();
 }
 
-llvm::LLVMContext context;
-llvm::Module* module;
-llvm::IRBuilder<> builder(context);
-int gvar_count = 105;
-map<string, llvm::Value *> string_to_llvm;
-llvm::Function *curr_fxn;
-map<llvm::BasicBlock*, bool> created_bb;
+// an empty module in a context of its own, the previous one is released
+static void createModule() {
+  releaseLLVMIr();
+  context = new llvm::LLVMContext();
+  builder = new llvm::IRBuilder<>(*context);
+  module = new llvm::Module("top", *context);
+}
+
+// hash-cons number of the expression rooted at n, NOT_PURE if it is not one
+uint32_t exprNumber(Node *n) {
+  if (n == NULL) return NOT_PURE;
+  unordered_map<Node *, uint32_t>::iterator memo = node_numbers.find(n);
+  if (memo != node_numbers.end())
+    return memo->second;
+  ExprKey key = {n->getKind(), 0, 0, 0};
+  vector<Symbol> reads;
+  switch (n->getKind()) {
+  case _INT_CONST:
+    key.a = (uint32_t)static_cast<IntConst *>(n)->getVal();
+    break;
+  case _IDENTIFIER_LIST: {
+    IdentifierList *var = static_cast<IdentifierList *>(n);
+    if (var->getSymbols().size() != 1 || var->getPointerCount() != 0)
+      return node_numbers[n] = NOT_PURE;
+    key.a = var->getSymbol();
+    reads.push_back(key.a);
+    break;
+  }
+  case _ARITHMATIC:
+  case _BITWISE:
+  case _COMPARISION: {
+    Node *left, *right;
+    if (Arithmatic *a = nodeCast<Arithmatic *>(n)) {
+      key.op = a->getOp(); left = a->getLeft(); right = a->getRight();
+    }
+    else if (Bitwise *b = nodeCast<Bitwise *>(n)) {
+      key.op = b->getOp(); left = b->getLeft(); right = b->getRight();
+    }
+    else {
+      Comparision *c = static_cast<Comparision *>(n);
+      key.op = c->getOp(); left = c->getLeft(); right = c->getRight();
+    }
+    key.a = exprNumber(left);
+    key.b = exprNumber(right);
+    if (key.a == NOT_PURE || key.b == NOT_PURE)
+      return node_numbers[n] = NOT_PURE;
+    reads = expr_reads[key.a];
+    reads.insert(reads.end(), expr_reads[key.b].begin(), expr_reads[key.b].end());
+    break;
+  }
+  default:
+    return node_numbers[n] = NOT_PURE;
+  }
+  unordered_map<ExprKey, uint32_t, ExprKeyHash>::iterator it = expr_numbers.find(key);
+  if (it == expr_numbers.end()) {
+    it = expr_numbers.insert(make_pair(key, (uint32_t)expr_reads.size())).first;
+    expr_reads.push_back(reads);
+  }
+  return node_numbers[n] = it->second;
+}
+
+// value of expression number in the current block, NULL if not computed yet
+llvm::Value *cseLookup(uint32_t number) {
+  if (number == NOT_PURE) return NULL;
+  if (builder->GetInsertBlock() != cse_block) {
+    cse_block = builder->GetInsertBlock();
+    cse_values.clear();
+  }
+  unordered_map<uint32_t, llvm::Value *>::iterator it = cse_values.find(number);
+  return it == cse_values.end() ? NULL : it->second;
+}
+
+void cseRecord(uint32_t number, llvm::Value *v) {
+  if (number == NOT_PURE || v == NULL) return;
+  if (builder->GetInsertBlock() != cse_block) {
+    cse_block = builder->GetInsertBlock();
+    cse_values.clear();
+  }
+  cse_values[number] = v;
+}
+
+// variable s changed, forget every value that read it
+void cseKill(Symbol s) {
+  for (unordered_map<uint32_t, llvm::Value *>::iterator it = cse_values.begin();
+       it != cse_values.end(); ) {
+    vector<Symbol> &reads = expr_reads[it->first];
+    if (find(reads.begin(), reads.end(), s) != reads.end())
+      it = cse_values.erase(it);
+    else
+      ++it;
+  }
+}
 
 // given type opcode, return llvm type *
 llvm::Type * getLLVMType(Tp t) {
   switch (t) {
-    case _INT : return builder.getInt32Ty();
-    case _VOID: return builder.getVoidTy();
-    default   : {cout << "type not implemented\n";
-                 return builder.getInt32Ty();} 
+    case _INT : return builder->getInt32Ty();
+    case _VOID: return builder->getVoidTy();
+    default   : {cerr << "type not implemented\n";
+                 return builder->getInt32Ty();} 
   }
 }
 
@@ -49,548 +276,2178 @@ inline bool isPointer(llvm::Value *v) {
 
 inline llvm::Value * load(llvm::Value *v) {
   if (isPointer(v))
-    return builder.CreateLoad(v);
+    return builder->CreateLoad(v);
   else return v;
 }
 
+// value of an int expression, comparisons give i1 and are widened
+inline llvm::Value *toInt(llvm::Value *v) {
+  if (v == NULL) return v;
+  v = load(v);
+  if (v->getType()->isIntegerTy(1))
+    return builder->CreateZExt(v, builder->getInt32Ty());
+  return v;
+}
+
+// i1 for a condition, any other int is compared against 0 like in C
+inline llvm::Value *toBool(llvm::Value *v) {
+  if (v == NULL) return v;
+  v = load(v);
+  if (v->getType()->isIntegerTy(1))
+    return v;
+  return builder->CreateICmpNE(v, llvm::ConstantInt::get(v->getType(), 0));
+}
+
 inline llvm::Value *getPointer(llvm::Value *v) {
   /* !!! implemented only from integers !!! */
   if (isPointer(v)) return v;
-  return builder.CreateIntToPtr(v, v->getType()->getPointerTo());
+  return builder->CreateIntToPtr(v, v->getType()->getPointerTo());
 }
 
 inline llvm::Value *store(llvm::Value *v) {
   return getPointer(v);
 }
 
-void iterateBB(llvm::Function *f) {
-  int count = 0;
-  for (llvm::Function::iterator b = f->begin(), be = f->end(); b != be; ++b) {
-    ++count;
+// stack slot in the entry block of the function being generated, after the
+// allocas already there. Slots made anywhere else (a loop body) would grow the
+// stack on every iteration and mem2reg could not promote them.
+llvm::AllocaInst *createEntryAlloca(llvm::Type *t, const string &name) {
+  llvm::BasicBlock *bb = builder->GetInsertBlock();
+  if (bb == NULL || bb->getParent() == NULL)
+    return builder->CreateAlloca(t, 0, name);
+  llvm::BasicBlock &entry = bb->getParent()->getEntryBlock();
+  llvm::BasicBlock::iterator it = entry.begin();
+  while (it != entry.end() && llvm::isa<llvm::AllocaInst>(*it))
+    ++it;
+  llvm::IRBuilder<> entry_builder(&entry, it);
+  return entry_builder.CreateAlloca(t, 0, name);
+}
+
+// number of operators in n when it is cheap to evaluate unconditionally:
+// no calls, no assignments and nothing that traps (/ and %). -1 otherwise.
+int cheapCost(Node *n) {
+  if (n == NULL) return -1;
+  Node *left, *right;
+  switch (n->getKind()) {
+  case _INT_CONST:
+  case _IDENTIFIER_LIST:
+    return 0;
+  case _ARITHMATIC: {
+    Arithmatic *t = static_cast<Arithmatic *>(n);
+    if (t->getOp() == _DIV || t->getOp() == _MOD) return -1;
+    left = t->getLeft(); right = t->getRight();
+    break;
+  }
+  case _BITWISE: {
+    Bitwise *t = static_cast<Bitwise *>(n);
+    left = t->getLeft(); right = t->getRight();
+    break;
+  }
+  case _COMPARISION: {
+    Comparision *t = static_cast<Comparision *>(n);
+    left = t->getLeft(); right = t->getRight();
+    break;
+  }
+  case _BOOLEAN: {
+    Boolean *t = static_cast<Boolean *>(n);
+    left = t->getLeft(); right = t->getRight();
+    break;
+  }
+  default:
+    return -1;
   }
-  cout << "fxn name: ";
-  llvm::errs() << f->getName(); 
-  cout << " bbs: " << count << endl;
+  int l = cheapCost(left), r = cheapCost(right);
+  if (l < 0 || r < 0) return -1;
+  return l + r + 1;
+}
+
+// declare the function in the current module, returns the existing one if any
+llvm::Function *declareFunction(FxnDef *fxn_def) {
+  string fxn_name = fxn_def->getFxnName();
+  vector<Tp> arg_types = fxn_def->getArgTypes();
+  Tp ret_type = fxn_def->getRetType();
+  int arg_size = arg_types.size();
+  // setting up arg for llvm function
+  vector<llvm::Type *> llvm_fxn_argT;
+  for (int i=0; i<arg_size; ++i)
+    llvm_fxn_argT.push_back(getLLVMType(arg_types[i]));
+  llvm::ArrayRef<llvm::Type *> llvm_arg_ref(llvm_fxn_argT);
+  // setting up ret typr for llvm function
+  llvm::FunctionType * llvm_fxn_type = 
+    llvm::FunctionType::get(getLLVMType(ret_type), llvm_arg_ref, false);
+  // declaring the function
+  llvm::Constant *c = module->getOrInsertFunction(fxn_name, llvm_fxn_type);
+  llvm::Function *fxn = llvm::cast<llvm::Function>(c);
+  symbol_to_llvm.insert(fxn_def->getFxnSymbol(), fxn);
+  return fxn;
+}
+
+// declare every function defined in p, calls then resolve in any order
+void declareFunctions(Program *p) {
+  vector<Node *> &nodes = p->getNodes();
+  int size = nodes.size();
+  for (int i=0; i<size; ++i)
+    if (FxnDef *fxn_def = nodeCast<FxnDef *>(nodes[i]))
+      declareFunction(fxn_def);
 }
 
 // dump the node recure if needed
 llvm::Value* dumpNodeIr(Node *r) {
-  if (dynamic_cast<IntConst *>(r) != NULL) {
-    IntConst *temp = dynamic_cast<IntConst *>(r);
+  if (r == NULL) return nullptr;
+  switch (r->getKind()) {
+  case _INT_CONST: {
+    IntConst *temp = static_cast<IntConst *>(r);
     int value = temp->getVal();
     string name = "%"+to_string(gvar_count++);
     llvm::ConstantInt* const_int = llvm::ConstantInt::get(module->getContext(), llvm::APInt(32,value));
     return const_int;
   }
-  else if (dynamic_cast<StrConst *>(r) != NULL) {
-
-  }
-  else if (dynamic_cast<Program *>(r) != NULL) {
-    Program *temp = dynamic_cast<Program *>(r);
-    vector<Node *> nodes = temp->getNodes();
+  case _STR_CONST:
+    break;
+  case _PROGRAM: {
+    Program *temp = static_cast<Program *>(r);
+    vector<Node *> &nodes = temp->getNodes();
     int size = nodes.size();
     for (int i=0; i<size; ++i) {
       dumpNodeIr(nodes[i]);
     }
+    break;
   }
-  else if (dynamic_cast<Block *>(r) != NULL) {
-    Block *temp_block = dynamic_cast<Block *>(r);
-    vector<Node *> statements = temp_block->getStatements();
+  case _BLOCK: {
+    Block *temp_block = static_cast<Block *>(r);
+    vector<Node *> &statements = temp_block->getStatements();
     int size = statements.size();
-    for (int i=0; i<size; ++i)
+    symbol_to_llvm.pushScope();
+    // nothing after a return is reachable, and a terminated block takes no more
+    for (int i=0; i<size && builder->GetInsertBlock()->getTerminator() == NULL; ++i)
       dumpNodeIr(statements[i]);
+    symbol_to_llvm.popScope();
+    // names declared here mean the outer variables again
+    for (int i=0; i<size; ++i)
+      if (FDeclaration *decl = nodeCast<FDeclaration *>(statements[i]))
+        if (nodeCast<IdentifierList *>(decl->getNameArg()) != NULL)
+          cseKill(decl->getVarSymbol());
+    break;
   }
-  else if (dynamic_cast<Arithmatic *>(r) != NULL) {
-    Arithmatic *temp = dynamic_cast<Arithmatic *>(r);
+  case _ARITHMATIC: {
+    Arithmatic *temp = static_cast<Arithmatic *>(r);
     Node *left = temp->getLeft();
     Node *right = temp->getRight();
     AriOp op = temp->getOp();
-    llvm::Value *llvm_lval = load(dumpNodeIr(left));
-    llvm::Value *llvm_rval = load(dumpNodeIr(right));
-    llvm::Value *llvm_val;
+    uint32_t number = exprNumber(r);
+    if (llvm::Value *v = cseLookup(number))
+      return v;
+    llvm::Value *llvm_lval = toInt(dumpNodeIr(left));
+    llvm::Value *llvm_rval = toInt(dumpNodeIr(right));
+    llvm::Value *llvm_val = NULL;
     if (op == _ADD)
-      llvm_val = builder.CreateAdd(llvm_lval, llvm_rval);
+      llvm_val = builder->CreateAdd(llvm_lval, llvm_rval);
     else if (op == _SUB)
-      llvm_val = builder.CreateSub(llvm_lval, llvm_rval);
+      llvm_val = builder->CreateSub(llvm_lval, llvm_rval);
     else if (op == _MUL)
-      llvm_val = builder.CreateMul(llvm_lval, llvm_rval);
+      llvm_val = builder->CreateMul(llvm_lval, llvm_rval);
     else if (op == _DIV) {
-      llvm_val = builder.CreateSDiv(llvm_lval, llvm_rval);
+      llvm_val = builder->CreateSDiv(llvm_lval, llvm_rval);
     }
+    else if (op == _MOD)
+      llvm_val = builder->CreateSRem(llvm_lval, llvm_rval);
     else {
-      cout << "Other arithmatic operators needs to be implemented\n";
+      cerr << "Other arithmatic operators needs to be implemented\n";
     }
+    cseRecord(number, llvm_val);
     return llvm_val;
   }
-  else if (dynamic_cast<Bitwise *>(r) != NULL) {
-    Bitwise *temp_bitwise = dynamic_cast<Bitwise*>(r);
+  case _BITWISE: {
+    Bitwise *temp_bitwise = static_cast<Bitwise *>(r);
     Node *left = temp_bitwise->getLeft();
     Node *right = temp_bitwise->getRight();
     BitOp op = temp_bitwise->getOp();
-    llvm::Value *llvm_lval = load(dumpNodeIr(left));
-    llvm::Value *llvm_rval = load(dumpNodeIr(right));
-    llvm::Value *llvm_val;
+    uint32_t number = exprNumber(r);
+    if (llvm::Value *v = cseLookup(number))
+      return v;
+    llvm::Value *llvm_lval = toInt(dumpNodeIr(left));
+    llvm::Value *llvm_rval = toInt(dumpNodeIr(right));
+    llvm::Value *llvm_val = NULL;
     if (op == _AND) {
-      llvm_val = builder.CreateAnd(llvm_lval, llvm_rval);
+      llvm_val = builder->CreateAnd(llvm_lval, llvm_rval);
     }
     else if (op == _OR)
-      llvm_val = builder.CreateOr(llvm_lval, llvm_rval);
+      llvm_val = builder->CreateOr(llvm_lval, llvm_rval);
     else if (op == _XOR)
-      llvm_val = builder.CreateXor(llvm_lval, llvm_rval);
-    else if (op == _LSHIFT) {
-      IntConst *temp_int = dynamic_cast<IntConst *>(right);
-      if (temp_int == NULL) {
-        cout << "ASSUMPTION FAILED: Second oprand is not integer\n";
-        return nullptr;
-      }
-      int val = temp_int->getVal();
-      llvm_val = builder.CreateShl(llvm_lval, val);
-    }
-    else
-      cout << "No need to implement. ret value is anyway void.\n";
+      llvm_val = builder->CreateXor(llvm_lval, llvm_rval);
+    else if (op == _LSHIFT)
+      llvm_val = builder->CreateShl(llvm_lval, llvm_rval);
+    else if (op == _RSHIFT)
+      llvm_val = builder->CreateAShr(llvm_lval, llvm_rval);
+    cseRecord(number, llvm_val);
     return llvm_val;
   }
-  else if (dynamic_cast<Comparision *>(r) != NULL) {
-    Comparision *temp = dynamic_cast<Comparision *>(r);
+  case _COMPARISION: {
+    Comparision *temp = static_cast<Comparision *>(r);
     CompOp op = temp->getOp();
     Node *left = temp->getLeft();
     Node *right = temp->getRight();
+    uint32_t number = exprNumber(r);
+    if (llvm::Value *v = cseLookup(number))
+      return v;
 
-    llvm::Value *llvm_left = load(dumpNodeIr(left));
-    llvm::Value *llvm_right = load(dumpNodeIr(right));
-    llvm::Value *comp_instr;
+    llvm::Value *llvm_left = toInt(dumpNodeIr(left));
+    llvm::Value *llvm_right = toInt(dumpNodeIr(right));
+    llvm::Value *comp_instr = NULL;
 
     if (op == _LT)
-      comp_instr = builder.CreateICmpSLT(llvm_left, llvm_right);
+      comp_instr = builder->CreateICmpSLT(llvm_left, llvm_right);
     else if (op == _GT)
-      comp_instr = builder.CreateICmpSGT(llvm_left, llvm_right);
+      comp_instr = builder->CreateICmpSGT(llvm_left, llvm_right);
     else if (op == _GEQ)
-      comp_instr = builder.CreateICmpSGE(llvm_left, llvm_right);
+      comp_instr = builder->CreateICmpSGE(llvm_left, llvm_right);
     else if (op == _LEQ)
-      comp_instr = builder.CreateICmpSLE(llvm_left, llvm_right);
+      comp_instr = builder->CreateICmpSLE(llvm_left, llvm_right);
     else if (op == _EQEQ)
-      comp_instr = builder.CreateICmpEQ(llvm_left, llvm_right);
+      comp_instr = builder->CreateICmpEQ(llvm_left, llvm_right);
     else if (op == _NEQ)
-      comp_instr = builder.CreateICmpNE(llvm_left, llvm_right);
+      comp_instr = builder->CreateICmpNE(llvm_left, llvm_right);
     
+    cseRecord(number, comp_instr);
     return comp_instr;
   }
-  else if (dynamic_cast<Boolean *>(r) != NULL) {
-    Boolean *temp = dynamic_cast<Boolean *>(r);
+  case _BOOLEAN: {
+    Boolean *temp = static_cast<Boolean *>(r);
     BoolOp op = temp->getOp();
     Node *left = temp->getLeft();
     Node *right = temp->getRight();
 
-    llvm::Value *llvm_left = dumpNodeIr(left);
-    llvm::Value *llvm_right = dumpNodeIr(right);
-    llvm::Value *llvm_val;
+    llvm::Value *llvm_left = toBool(dumpNodeIr(left));
+    llvm::Value *llvm_val = NULL;
 
-    if (op == _ANDAND) {
-      llvm_val = builder.CreateAnd(llvm_left, llvm_right);
-    }
-    else if (op == _OROR) {
-      llvm_val = builder.CreateOr(llvm_left, llvm_right);
+    // a small rhs that cannot trap or call anything is cheaper to just compute
+    int cost = cheapCost(right);
+    if (cost >= 0 && cost <= 8) {
+      llvm::Value *llvm_right = toBool(dumpNodeIr(right));
+      if (op == _ANDAND)
+        llvm_val = builder->CreateSelect(llvm_left, llvm_right, builder->getFalse());
+      else
+        llvm_val = builder->CreateSelect(llvm_left, builder->getTrue(), llvm_right);
+      return llvm_val;
     }
-    return llvm_val;
+
+    // otherwise the rhs only runs when the lhs does not decide
+    llvm::BasicBlock *lhs_end = builder->GetInsertBlock();
+    llvm::BasicBlock *rhs = llvm::BasicBlock::Create(*context, "bool_rhs", curr_fxn);
+    created_bb[rhs] = true;
+    llvm::BasicBlock *merge = llvm::BasicBlock::Create(*context, "bool_merge", curr_fxn);
+    created_bb[merge] = true;
+    if (op == _ANDAND)
+      builder->CreateCondBr(llvm_left, rhs, merge);
+    else
+      builder->CreateCondBr(llvm_left, merge, rhs);
+    builder->SetInsertPoint(rhs);
+    llvm::Value *llvm_right = toBool(dumpNodeIr(right));
+    llvm::BasicBlock *rhs_end = builder->GetInsertBlock();
+    builder->CreateBr(merge);
+    builder->SetInsertPoint(merge);
+    llvm::PHINode *phi = builder->CreatePHI(builder->getInt1Ty(), 2);
+    phi->addIncoming(op == _ANDAND ? builder->getFalse() : builder->getTrue(), lhs_end);
+    phi->addIncoming(llvm_right, rhs_end);
+    return phi;
   }
-  else if (dynamic_cast<Assign *>(r) != NULL) {
-    Assign *temp = dynamic_cast<Assign *>(r);
+  case _ASSIGN: {
+    Assign *temp = static_cast<Assign *>(r);
     Node *lhs = temp->getLHS();
     Node *rhs = temp->getRHS();
     llvm::Value *llvm_lhs = store(dumpNodeIr(lhs));
-    llvm::Value *llvm_rhs = load(dumpNodeIr(rhs));
-    return builder.CreateStore(llvm_rhs, llvm_lhs);
+    llvm::Value *llvm_rhs = toInt(dumpNodeIr(rhs));
+    llvm::Value *llvm_store = builder->CreateStore(llvm_rhs, llvm_lhs);
+    if (IdentifierList *var = nodeCast<IdentifierList *>(lhs))
+      cseKill(var->getSymbol());
+    return llvm_store;
   }
-  else if (dynamic_cast<Return *>(r) != NULL) {
-    Return *temp = dynamic_cast<Return *>(r);
+  case _RETURN: {
+    Return *temp = static_cast<Return *>(r);
     Node *ret_value = temp->getNode();
-    llvm::Value *llvm_ret_value = load(dumpNodeIr(ret_value));
-    llvm::Value *llvm_ret_ins = builder.CreateRet(llvm_ret_value);
-//    llvm::BasicBlock * post_ret = llvm::BasicBlock::Create(context,
+    llvm::Value *llvm_ret_value = toInt(dumpNodeIr(ret_value));
+    llvm::Value *llvm_ret_ins = builder->CreateRet(llvm_ret_value);
+//    llvm::BasicBlock * post_ret = llvm::BasicBlock::Create(*context,
 //                                    "post_return", curr_fxn);
-//    builder.SetInsertPoint(post_ret);
+//    builder->SetInsertPoint(post_ret);
     return llvm_ret_ins;
   }
-  else if (dynamic_cast<Identifier *>(r) != NULL) {
-
-  }
-  else if (dynamic_cast<IdentifierList *>(r) != NULL) {
-    IdentifierList *temp = dynamic_cast<IdentifierList *>(r);
-    string var_name = temp->getString();
-    if (string_to_llvm.find(var_name) == string_to_llvm.end()) {
-      cout << "Sematic Error: variable used before defined.\n";
+  case _IDENTIFIER:
+    break;
+  case _IDENTIFIER_LIST: {
+    IdentifierList *temp = static_cast<IdentifierList *>(r);
+    llvm::Value **var = symbol_to_llvm.lookup(temp->getSymbol());
+    if (var == NULL) {
+      cerr << "Sematic Error: variable used before defined.\n";
       return nullptr;
     }
-    return string_to_llvm[var_name];
+    return *var;
   }
-  else if (dynamic_cast<Declaration *>(r) != NULL) {
-
-  }
-  else if (dynamic_cast<ParameterList *>(r) != NULL) {
-
-  }
-  else if (dynamic_cast<Type *>(r) != NULL) {
-
-  }
-  else if (dynamic_cast<IfThen *>(r) != NULL) {
-    IfThen *temp = dynamic_cast<IfThen *>(r);
+  case _DECLARATION:
+    break;
+  case _PARAMETER_LIST:
+    break;
+  case _TYPE:
+    break;
+  case _IF_THEN: {
+    IfThen *temp = static_cast<IfThen *>(r);
     Node *cond = temp->getCond();
     Node *if_body = temp->getIfBody();
 
-    llvm::BasicBlock* cond_true = llvm::BasicBlock::Create(context,
+    llvm::BasicBlock* cond_true = llvm::BasicBlock::Create(*context,
                                     "cond_true", curr_fxn);
     created_bb[cond_true] = true;
-    llvm::BasicBlock* merge = llvm::BasicBlock::Create(context,
+    llvm::BasicBlock* merge = llvm::BasicBlock::Create(*context,
                                     "merge", curr_fxn);
     created_bb[merge] = true;
 
     // cond
-    llvm::Value *llvm_cond = dumpNodeIr(cond);
-    builder.CreateCondBr(llvm_cond, cond_true, merge);
+    llvm::Value *llvm_cond = toBool(dumpNodeIr(cond));
+    builder->CreateCondBr(llvm_cond, cond_true, merge);
     // if
-    builder.SetInsertPoint(cond_true);
+    builder->SetInsertPoint(cond_true);
     llvm::Value *llvm_if_body = dumpNodeIr(if_body);
+    if (builder->GetInsertBlock()->getTerminator() == NULL)
+      builder->CreateBr(merge);
     // merge
-    builder.SetInsertPoint(merge);
+    builder->SetInsertPoint(merge);
+    break;
   }
-  else if (dynamic_cast<IfThenElse *>(r) != NULL) {
+  case _IF_THEN_ELSE: {
     /* ---------------------------------------------------- */
     /* ASSUMPTION: if and else body ends with ret statement */
     /* -----------------------------------------------------*/
-    IfThenElse *temp = dynamic_cast<IfThenElse *>(r);
+    IfThenElse *temp = static_cast<IfThenElse *>(r);
     Node *cond = temp->getCond();
     Node *if_body = temp->getIfBody();
     Node *else_body = temp->getElseBody();
 
 
-    llvm::BasicBlock* cond_true = llvm::BasicBlock::Create(context, 
+    llvm::BasicBlock* cond_true = llvm::BasicBlock::Create(*context, 
                               "cond_true", curr_fxn);
     created_bb[cond_true] = true;
-    llvm::BasicBlock* cond_false = llvm::BasicBlock::Create(context, 
+    llvm::BasicBlock* cond_false = llvm::BasicBlock::Create(*context, 
                               "cond_false", curr_fxn);
     created_bb[cond_false] = true;
-//    llvm::BasicBlock* merge = llvm::BasicBlock::Create(context, 
+//    llvm::BasicBlock* merge = llvm::BasicBlock::Create(*context, 
 //                              "merge", curr_fxn);
 //    created_bb[merge] = true; 
     // cond
-    llvm::Value *llvm_cond = dumpNodeIr(cond);
-    builder.CreateCondBr(llvm_cond, cond_true, cond_false);
+    llvm::Value *llvm_cond = toBool(dumpNodeIr(cond));
+    builder->CreateCondBr(llvm_cond, cond_true, cond_false);
     // if
-    builder.SetInsertPoint(cond_true);
+    builder->SetInsertPoint(cond_true);
     llvm::Value *llvm_if_body = dumpNodeIr(if_body);
-//    builder.CreateBr(merge);
+//    builder->CreateBr(merge);
     // else
-    builder.SetInsertPoint(cond_false);
+    builder->SetInsertPoint(cond_false);
     llvm::Value *llvm_else_body = dumpNodeIr(else_body);
-//    builder.CreateBr(merge);
+//    builder->CreateBr(merge);
     // merge
-//    builder.SetInsertPoint(merge);
+//    builder->SetInsertPoint(merge);
+    break;
   }
-  else if (dynamic_cast<While *>(r) != NULL) {
-    While *temp = dynamic_cast<While *>(r);
+  case _WHILE: {
+    While *temp = static_cast<While *>(r);
     Node *cond = temp->getCond();
     Node *body = temp->getBody();
 
-    llvm::BasicBlock* cond_label = llvm::BasicBlock::Create(context,
+    llvm::BasicBlock* cond_label = llvm::BasicBlock::Create(*context,
                                 "cond", curr_fxn);
     created_bb[cond_label] = true;
-    llvm::BasicBlock *loop_body = llvm::BasicBlock::Create(context,
+    llvm::BasicBlock *loop_body = llvm::BasicBlock::Create(*context,
                                     "loop_body", curr_fxn);
     created_bb[loop_body] = true;
-    llvm::BasicBlock *merge = llvm::BasicBlock::Create(context,
+    llvm::BasicBlock *merge = llvm::BasicBlock::Create(*context,
                                 "merge", curr_fxn);
     created_bb[merge] = true;
     
     // cond
-    builder.CreateBr(cond_label);
-    builder.SetInsertPoint(cond_label);
-    llvm::Value *llvm_cond = dumpNodeIr(cond);
-    builder.CreateCondBr(llvm_cond, loop_body, merge);
+    builder->CreateBr(cond_label);
+    builder->SetInsertPoint(cond_label);
+    llvm::Value *llvm_cond = toBool(dumpNodeIr(cond));
+    builder->CreateCondBr(llvm_cond, loop_body, merge);
     // loop body
-    builder.SetInsertPoint(loop_body);
+    builder->SetInsertPoint(loop_body);
     llvm::Value *llvm_loop_body = dumpNodeIr(body);
-    builder.CreateBr(cond_label);
+    if (builder->GetInsertBlock()->getTerminator() == NULL)
+      builder->CreateBr(cond_label);
     // merge
-    builder.SetInsertPoint(merge);
+    builder->SetInsertPoint(merge);
+    break;
   }
-  else if (dynamic_cast<FxnNameArg *>(r) != NULL) {
-
-  }
-  else if (dynamic_cast<FxnDef *>(r) != NULL) {
+  case _FXN_NAME_ARG:
+    break;
+  case _FXN_DEF: {
     // fetching information from FxnDef
-    FxnDef *fxn_def = dynamic_cast<FxnDef *>(r);
-    string fxn_name = fxn_def->getFxnName();
+    FxnDef *fxn_def = static_cast<FxnDef *>(r);
+    SpanScope span(Interner::current()->str(fxn_def->getFxnSymbol()), "function");
     vector<string> arg_names = fxn_def->getArgNames();
+    vector<Symbol> arg_symbols = fxn_def->getArgSymbols();
     vector<Tp> arg_types = fxn_def->getArgTypes();
     Tp ret_type = fxn_def->getRetType();
     int arg_size = arg_types.size();
-    // setting up arg for llvm function
-    vector<llvm::Type *> llvm_fxn_argT;
-    for (int i=0; i<arg_size; ++i)
-      llvm_fxn_argT.push_back(getLLVMType(arg_types[i]));
-    llvm::ArrayRef<llvm::Type *> llvm_arg_ref(llvm_fxn_argT);
-    // setting up ret typr for llvm function
-    llvm::FunctionType * llvm_fxn_type = 
-      llvm::FunctionType::get(getLLVMType(ret_type), llvm_arg_ref, false);
-    // declaring the function
-    //llvm::Function *fxn = llvm::Function::Create(llvm_fxn_type, 
-      //llvm::Function::ExternalLinkage, fxn_name, module);
-    llvm::Constant *c = module->getOrInsertFunction(fxn_name, llvm_fxn_type);
-    llvm::Function *fxn = llvm::cast<llvm::Function>(c);
+    llvm::Function *fxn = declareFunction(fxn_def);
     curr_fxn = fxn;
-    string_to_llvm[fxn_name] = fxn;
     // defining the function
-    llvm::BasicBlock *entry = llvm::BasicBlock::Create(context, "entry", fxn);
+    llvm::BasicBlock *entry = llvm::BasicBlock::Create(*context, "entry", fxn);
     created_bb[entry] = true;
-    builder.SetInsertPoint(entry);
-    // setting up the variable names
+    builder->SetInsertPoint(entry);
+    // setting up the variable names, parameters live until the function ends
+    symbol_to_llvm.pushScope();
     llvm::Function::arg_iterator args = fxn->arg_begin();
     for (int i=0; i<arg_size; ++i) {
       llvm::Value *x = args++;
       x->setName(arg_names[i]);
-      llvm::Value *x_alloca = builder.CreateAlloca(getLLVMType(arg_types[i]), 0, "");
-      builder.CreateStore(x, x_alloca);
-      string_to_llvm[arg_names[i]] = x_alloca;
+      llvm::Value *x_alloca = createEntryAlloca(getLLVMType(arg_types[i]), "");
+      builder->CreateStore(x, x_alloca);
+      symbol_to_llvm.insert(arg_symbols[i], x_alloca);
     }
 
     // recurring on body
     Block *body = fxn_def->getBody();
     dumpNodeIr(body);
+    symbol_to_llvm.popScope();
 
     // return void if return type is void
     if (ret_type == _VOID)
-      builder.CreateRetVoid();
+      builder->CreateRetVoid();
+    break;
   }
-  else if (dynamic_cast<FDeclaration *>(r) != NULL) {
-    FDeclaration *temp = dynamic_cast<FDeclaration *>(r);
+  case _F_DECLARATION: {
+    FDeclaration *temp = static_cast<FDeclaration *>(r);
     Tp type = temp->getType();
     string name = temp->getVarName();
     if (name == "") { return nullptr;}
-    llvm::Value *alloca_ins = builder.CreateAlloca(getLLVMType(_INT), 0, name);
-    string_to_llvm[name] = alloca_ins;
-  }
-  else if (dynamic_cast<FxnCall *>(r) != NULL) {
-    FxnCall *temp = dynamic_cast<FxnCall *>(r);
-    string callee_name = temp->getFxnName();
-    if (string_to_llvm.find(callee_name) == string_to_llvm.end()) {
-      cout << "Semantic Error: Function called without declaring or defining\n";
+    llvm::Value *alloca_ins = createEntryAlloca(getLLVMType(_INT), name);
+    symbol_to_llvm.insert(temp->getVarSymbol(), alloca_ins);
+    // the name means a new variable from here on
+    cseKill(temp->getVarSymbol());
+    break;
+  }
+  case _FXN_CALL: {
+    FxnCall *temp = static_cast<FxnCall *>(r);
+    llvm::Value **callee = symbol_to_llvm.lookup(temp->getFxnSymbol());
+    if (callee == NULL) {
+      cerr << "Semantic Error: Function called without declaring or defining\n";
       return nullptr;
     }
 
-    ParameterList *args_list = dynamic_cast<ParameterList *>(temp->getNode());
-    vector<Node *> args_nodes = args_list->getParams();
+    ParameterList *args_list = nodeCast<ParameterList *>(temp->getNode());
+    vector<Node *> &args_nodes = args_list->getParams();
     int args_size = args_nodes.size();
     vector<llvm::Value *> llvm_args;
     for (int i=0; i<args_size; ++i) {
-      llvm::Value * llvm_arg = dumpNodeIr(args_nodes[i]);
-      llvm_args.push_back(llvm_arg); // not sure about pointers
+      llvm::Value * llvm_arg = toInt(dumpNodeIr(args_nodes[i]));
+      llvm_args.push_back(llvm_arg); // by value, variables are loaded
     }
     llvm::ArrayRef<llvm::Value *> llvm_args_obj(llvm_args);
-    return builder.CreateCall(string_to_llvm[callee_name], llvm_args_obj);
+    // the callee may write any global
+    cse_values.clear();
+    return builder->CreateCall(*callee, llvm_args_obj);
+  }
+  case _TEMPORARY: {
+    cerr << "AST should not have a temporary\n";
+    break;
   }
-  else if (dynamic_cast<Temporary *>(r) != NULL) {
-    cout << "AST should not have a temporary\n";
   }
   return nullptr;
 }
 
-// dump the llvm ir corresponding to ast rooted at n
-void dumpLLVMIr(Node *n, string outfile_name) {
-  module = new llvm::Module("top", context);
-  // dumping the ast
-  dumpNodeIr(n);
+// functions called anywhere below n, with repeats
+static void collectCallees(Node *n, vector<Symbol> &callees) {
+  if (n == NULL) return;
+  switch (n->getKind()) {
+  case _FXN_CALL: {
+    FxnCall *temp = static_cast<FxnCall *>(n);
+    callees.push_back(temp->getFxnSymbol());
+    collectCallees(temp->getNode(), callees);
+    break;
+  }
+  case _BLOCK: {
+    vector<Node *> &nodes = static_cast<Block *>(n)->getStatements();
+    for (size_t i=0; i<nodes.size(); ++i) collectCallees(nodes[i], callees);
+    break;
+  }
+  case _PARAMETER_LIST: {
+    vector<Node *> &nodes = static_cast<ParameterList *>(n)->getParams();
+    for (size_t i=0; i<nodes.size(); ++i) collectCallees(nodes[i], callees);
+    break;
+  }
+  case _ASSIGN: {
+    Assign *temp = static_cast<Assign *>(n);
+    collectCallees(temp->getLHS(), callees);
+    collectCallees(temp->getRHS(), callees);
+    break;
+  }
+  case _ARITHMATIC: {
+    Arithmatic *temp = static_cast<Arithmatic *>(n);
+    collectCallees(temp->getLeft(), callees);
+    collectCallees(temp->getRight(), callees);
+    break;
+  }
+  case _BITWISE: {
+    Bitwise *temp = static_cast<Bitwise *>(n);
+    collectCallees(temp->getLeft(), callees);
+    collectCallees(temp->getRight(), callees);
+    break;
+  }
+  case _COMPARISION: {
+    Comparision *temp = static_cast<Comparision *>(n);
+    collectCallees(temp->getLeft(), callees);
+    collectCallees(temp->getRight(), callees);
+    break;
+  }
+  case _BOOLEAN: {
+    Boolean *temp = static_cast<Boolean *>(n);
+    collectCallees(temp->getLeft(), callees);
+    collectCallees(temp->getRight(), callees);
+    break;
+  }
+  case _RETURN:
+    collectCallees(static_cast<Return *>(n)->getNode(), callees);
+    break;
+  case _IF_THEN: {
+    IfThen *temp = static_cast<IfThen *>(n);
+    collectCallees(temp->getCond(), callees);
+    collectCallees(temp->getIfBody(), callees);
+    break;
+  }
+  case _IF_THEN_ELSE: {
+    IfThenElse *temp = static_cast<IfThenElse *>(n);
+    collectCallees(temp->getCond(), callees);
+    collectCallees(temp->getIfBody(), callees);
+    collectCallees(temp->getElseBody(), callees);
+    break;
+  }
+  case _WHILE: {
+    While *temp = static_cast<While *>(n);
+    collectCallees(temp->getCond(), callees);
+    collectCallees(temp->getBody(), callees);
+    break;
+  }
+  default:
+    break;
+  }
+}
 
+// generate a single function into a fresh module and context of this thread
+// and return it as bitcode, the module dies with the call. Only the
+// function and what it calls are declared, linking stays linear.
+static string dumpFunctionBitcode(FxnDef *fxn_def, map<Symbol, FxnDef *> &defs) {
+  createModule();
+  declareFunction(fxn_def);
+  vector<Symbol> callees;
+  collectCallees(fxn_def->getBody(), callees);
+  sort(callees.begin(), callees.end());
+  callees.erase(unique(callees.begin(), callees.end()), callees.end());
+  for (size_t i=0; i<callees.size(); ++i) {
+    map<Symbol, FxnDef *>::iterator def = defs.find(callees[i]);
+    // an undefined callee is reported by codegen, as without -j
+    if (def != defs.end() && def->second != fxn_def)
+      declareFunction(def->second);
+  }
+  dumpNodeIr(fxn_def);
+
+  string buffer;
+  llvm::raw_string_ostream os(buffer);
+  llvm::WriteBitcodeToFile(*module, os);
+  os.flush();
+  releaseLLVMIr();
+  return buffer;
+}
+
+// function definitions are generated by `jobs` workers, each one with its own
+// context. The per function modules are then linked into `module` in source
+// order, anything that is not a function is generated here as usual. The
+// workers never see those top level nodes, a global is not visible to them.
+static void dumpProgramParallel(Program *p, int jobs) {
+  vector<Node *> &nodes = p->getNodes();
+  int size = nodes.size();
+  vector<string> bitcode(size);
+  atomic<int> next(0);
+  vector<thread> workers;
+  // names and defs are only read from here on, the workers share them
+  Interner *names = Interner::current();
+  map<Symbol, FxnDef *> defs;
+  for (int i=0; i<size; ++i)
+    if (FxnDef *fxn_def = nodeCast<FxnDef *>(nodes[i]))
+      defs[fxn_def->getFxnSymbol()] = fxn_def;
+  for (int t=0; t<jobs; ++t) {
+    workers.push_back(thread([&]() {
+      InternerScope names_scope(*names);
+      for (int i = next++; i < size; i = next++)
+        if (FxnDef *fxn_def = nodeCast<FxnDef *>(nodes[i]))
+          bitcode[i] = dumpFunctionBitcode(fxn_def, defs);
+    }));
+  }
+  for (int t=0; t<jobs; ++t)
+    workers[t].join();
+
+  for (int i=0; i<size; ++i) {
+    if (nodeCast<FxnDef *>(nodes[i]) == NULL) {
+      dumpNodeIr(nodes[i]);
+      continue;
+    }
+    llvm::Expected<unique_ptr<llvm::Module>> fxn_module =
+      llvm::parseBitcodeFile(llvm::MemoryBufferRef(bitcode[i], "fxn"), *context);
+    if (!fxn_module) {
+      llvm::logAllUnhandledErrors(fxn_module.takeError(), llvm::errs(), "cc: ");
+      continue;
+    }
+    if (llvm::Linker::linkModules(*module, move(*fxn_module)))
+      cerr << "ERROR: could not link function module\n";
+  }
+}
+
+// passes that --passes= understands, NULL for an unknown name
+static llvm::Pass *createPassByName(const string &name) {
+  if (name == "mem2reg")      return llvm::createPromoteMemoryToRegisterPass();
+  if (name == "sroa")         return llvm::createSROAPass();
+  if (name == "early-cse")    return llvm::createEarlyCSEPass();
+  if (name == "instcombine")  return llvm::createInstructionCombiningPass();
+  if (name == "reassociate")  return llvm::createReassociatePass();
+  if (name == "gvn")          return llvm::createGVNPass();
+  if (name == "simplifycfg")  return llvm::createCFGSimplificationPass();
+  if (name == "dce")          return llvm::createDeadCodeEliminationPass();
+  if (name == "loop-rotate")  return llvm::createLoopRotatePass();
+  if (name == "licm")         return llvm::createLICMPass();
+  if (name == "loop-unroll")  return llvm::createLoopUnrollPass();
+  if (name == "tailcallelim") return llvm::createTailCallEliminationPass();
+  if (name == "inline")       return llvm::createFunctionInliningPass();
+  return NULL;
+}
+
+static vector<string> splitPassList(string passes) {
+  vector<string> names;
+  size_t start = 0;
+  while (start <= passes.size()) {
+    size_t comma = passes.find(',', start);
+    if (comma == string::npos) comma = passes.size();
+    if (comma > start)
+      names.push_back(passes.substr(start, comma - start));
+    start = comma + 1;
+  }
+  return names;
+}
+
+bool checkPassList(string passes) {
+  vector<string> names = splitPassList(passes);
+  int size = names.size();
+  for (int i=0; i<size; ++i) {
+    llvm::Pass *pass = createPassByName(names[i]);
+    if (pass == NULL) {
+      cerr << "cc: unknown pass " << names[i] << "\n";
+      return false;
+    }
+    delete pass;
+  }
+  return true;
+}
+
+// register the host target once per process, any thread may ask first
+static void initNativeTarget() {
+  static once_flag init_native;
+  call_once(init_native, []() {
+    llvm::InitializeNativeTarget();
+    llvm::InitializeNativeTargetAsmPrinter();
+  });
+}
+
+// machine for the host, NULL (and a message) if LLVM was built without it
+static llvm::TargetMachine *createHostMachine(int opt_level) {
+  PhaseScope phase("target");
+  initNativeTarget();
+  string triple = llvm::sys::getDefaultTargetTriple();
+  string error;
+  const llvm::Target *target = llvm::TargetRegistry::lookupTarget(triple, error);
+  if (target == NULL) {
+    cerr << "cc: " << error << "\n";
+    return NULL;
+  }
+  llvm::SubtargetFeatures features;
+  llvm::StringMap<bool> host_features;
+  if (llvm::sys::getHostCPUFeatures(host_features))
+    for (llvm::StringMap<bool>::iterator f = host_features.begin(),
+         fe = host_features.end(); f != fe; ++f)
+      features.AddFeature(f->first(), f->second);
+  llvm::CodeGenOpt::Level level = opt_level == 0 ? llvm::CodeGenOpt::None
+                                : opt_level == 1 ? llvm::CodeGenOpt::Less
+                                : opt_level == 2 ? llvm::CodeGenOpt::Default
+                                : llvm::CodeGenOpt::Aggressive;
+  return target->createTargetMachine(triple, llvm::sys::getHostCPUName(),
+                                     features.getString(), llvm::TargetOptions(),
+                                     llvm::Optional<llvm::Reloc::Model>(llvm::Reloc::PIC_),
+                                     llvm::None, level);
+}
+
+// run opts.passes in order, or the standard pipeline of opts.opt_level.
+// With a target machine the passes see the real costs of the host.
+static void optimizeModule(llvm::Module &m, IrOptions &opts,
+                           llvm::TargetMachine *tm) {
+  if (opts.passes.empty() && opts.opt_level == 0)
+    return;
+  PhaseScope phase("optimize", opts.stage);
+  llvm::legacy::PassManager mpm;
+  llvm::legacy::FunctionPassManager fpm(&m);
+  if (tm != NULL) {
+    mpm.add(llvm::createTargetTransformInfoWrapperPass(tm->getTargetIRAnalysis()));
+    fpm.add(llvm::createTargetTransformInfoWrapperPass(tm->getTargetIRAnalysis()));
+  }
+  if (!opts.passes.empty()) {
+    vector<string> names = splitPassList(opts.passes);
+    int size = names.size();
+    for (int i=0; i<size; ++i)
+      if (llvm::Pass *pass = createPassByName(names[i]))
+        mpm.add(pass);
+  }
+  else {
+    llvm::PassManagerBuilder pmb;
+    pmb.OptLevel = opts.opt_level;
+    pmb.SizeLevel = 0;
+    if (opts.opt_level > 1)
+      pmb.Inliner = llvm::createFunctionInliningPass(opts.opt_level, 0, false);
+    else
+      pmb.Inliner = llvm::createAlwaysInlinerLegacyPass();
+    pmb.LoopVectorize = opts.opt_level > 1;
+    pmb.SLPVectorize = opts.opt_level > 1;
+    if (tm != NULL)
+      tm->adjustPassManager(pmb);
+    pmb.populateFunctionPassManager(fpm);
+    pmb.populateModulePassManager(mpm);
+  }
+
+  llvm::TimePassesIsEnabled = opts.time_passes;
+  fpm.doInitialization();
+  for (llvm::Module::iterator f = m.begin(), fe = m.end(); f != fe; ++f)
+    fpm.run(*f);
+  fpm.doFinalization();
+  mpm.run(m);
+  if (opts.time_passes)
+    llvm::reportAndResetTimings();
+  llvm::TimePassesIsEnabled = false;
+}
+
+bool dumpLLVMIr(Node *n, string outfile_name, IrOptions &opts) {
+  int jobs = opts.jobs;
+  // the module of the previous call is not needed any more
+  createModule();
+  {
+    PhaseScope phase("codegen", opts.stage);
+    // declaring first keeps functions in source order and lets calls go forward
+    Program *p = nodeCast<Program *>(n);
+    if (p != NULL)
+      declareFunctions(p);
+    // dumping the ast
+    if (p != NULL && jobs > 1)
+      dumpProgramParallel(p, jobs);
+    else
+      dumpNodeIr(n);
+  }
+
+  // machine code needs the host target, the pass pipeline profits from it
+  llvm::TargetMachine *tm = NULL;
+  bool native = opts.emit == _EMIT_OBJ || opts.emit == _EMIT_ASM;
+  if (native || opts.opt_level > 0 || !opts.passes.empty()) {
+    tm = createHostMachine(opts.opt_level);
+    if (tm != NULL) {
+      module->setTargetTriple(tm->getTargetTriple().str());
+      module->setDataLayout(tm->createDataLayout());
+    }
+  }
+  optimizeModule(*module, opts, tm);
+
+  PhaseScope phase("emit", opts.stage);
   string file_name = outfile_name;
-  llvm::raw_ostream *out;
   error_code EC;
-  out = new llvm::raw_fd_ostream(file_name, EC, llvm::sys::fs::F_None);
+  // raw_fd_ostream buffers, the file is written in large chunks
+  llvm::raw_fd_ostream *out = new llvm::raw_fd_ostream(file_name, EC,
+                                (opts.emit == _EMIT_LL || opts.emit == _EMIT_ASM)
+                                ? llvm::sys::fs::F_Text : llvm::sys::fs::F_None);
+  // the echo shares stdout (and its buffer) with the AST dump
+  if (opts.echo && (EC || opts.emit != _EMIT_LL)) {
+    llvm::raw_os_ostream echo(cout);
+    module->print(echo, nullptr);
+  }
+  // dumping the module
+  bool written = !EC;
+  if (EC)
+    cerr << "cc: cannot write " << file_name << ": " << EC.message() << "\n";
+  else if (opts.emit == _EMIT_LL && opts.echo) {
+    // print once, the same text goes to the file and to stdout
+    string text;
+    llvm::raw_string_ostream os(text);
+    module->print(os, nullptr);
+    os.flush();
+    *out << text;
+    cout << text;
+  }
+  else if (opts.emit == _EMIT_LL)
+    module->print(*out, nullptr);
+  else if (opts.emit == _EMIT_BC)
+    llvm::WriteBitcodeToFile(*module, *out);
+  else if (tm == NULL) {
+    cerr << "cc: no native target, nothing written to " << file_name << "\n";
+    written = false;
+  }
+  else {
+    // object or assembly straight from the in memory module, no llc
+    llvm::legacy::PassManager codegen;
+    llvm::TargetMachine::CodeGenFileType type = opts.emit == _EMIT_OBJ
+      ? llvm::TargetMachine::CGFT_ObjectFile : llvm::TargetMachine::CGFT_AssemblyFile;
+    if (tm->addPassesToEmitFile(codegen, *out, nullptr, type)) {
+      cerr << "cc: target cannot emit this file type\n";
+      written = false;
+    }
+    else
+      codegen.run(*module);
+  }
+
+  // the last buffered chunk only goes out here, so can a full disk
+  if (!EC) {
+    out->close();
+    if (out->has_error()) {
+      cerr << "cc: error writing " << file_name << "\n";
+      out->clear_error();
+      written = false;
+    }
+  }
+  delete out;
+  delete tm;
+  // only the module stays, for runLLVMIr
+  resetCodegenState();
+  return written;
+}
+
+void releaseLLVMIr() {
+  resetCodegenState();
+  // the module first, it lives in the context
+  delete module;
+  module = NULL;
+  delete builder;
+  builder = NULL;
+  delete context;
+  context = NULL;
+}
+
+// The module lives in this thread's context, the JIT wants one it owns, so
+// the module is copied over as bitcode. Only the call of main is timed.
+bool runLLVMIr(int *ret, double *seconds) {
+  if (module == NULL || module->getFunction("main") == NULL) {
+    cerr << "cc: nothing to run, no main function\n";
+    return false;
+  }
+  initNativeTarget();
+  string buffer;
+  llvm::raw_string_ostream os(buffer);
+  llvm::WriteBitcodeToFile(*module, os);
+  os.flush();
+
+  llvm::orc::ThreadSafeContext jit_context(
+    unique_ptr<llvm::LLVMContext>(new llvm::LLVMContext()));
+  llvm::Expected<unique_ptr<llvm::Module>> jit_module = llvm::parseBitcodeFile(
+    llvm::MemoryBufferRef(buffer, "main"), *jit_context.getContext());
+  if (!jit_module) {
+    llvm::logAllUnhandledErrors(jit_module.takeError(), llvm::errs(), "cc: ");
+    return false;
+  }
+  llvm::Expected<llvm::orc::JITTargetMachineBuilder> jtmb =
+    llvm::orc::JITTargetMachineBuilder::detectHost();
+  if (!jtmb) {
+    llvm::logAllUnhandledErrors(jtmb.takeError(), llvm::errs(), "cc: ");
+    return false;
+  }
+  llvm::Expected<llvm::DataLayout> layout = jtmb->getDefaultDataLayoutForTarget();
+  if (!layout) {
+    llvm::logAllUnhandledErrors(layout.takeError(), llvm::errs(), "cc: ");
+    return false;
+  }
+  llvm::Expected<unique_ptr<llvm::orc::LLJIT>> jit =
+    llvm::orc::LLJIT::Create(move(*jtmb), move(*layout));
+  if (!jit) {
+    llvm::logAllUnhandledErrors(jit.takeError(), llvm::errs(), "cc: ");
+    return false;
+  }
+  (*jit_module)->setDataLayout((*jit)->getDataLayout());
+  llvm::Error added = (*jit)->addIRModule(
+    llvm::orc::ThreadSafeModule(move(*jit_module), jit_context));
+  if (added) {
+    llvm::logAllUnhandledErrors(move(added), llvm::errs(), "cc: ");
+    return false;
+  }
+  llvm::Expected<llvm::JITEvaluatedSymbol> main_sym = (*jit)->lookup("main");
+  if (!main_sym) {
+    llvm::logAllUnhandledErrors(main_sym.takeError(), llvm::errs(), "cc: ");
+    return false;
+  }
+
+  // called through its real type, a void main reports 0
+  bool void_main = module->getFunction("main")->getReturnType()->isVoidTy();
+  chrono::steady_clock::time_point start = chrono::steady_clock::now();
+  if (void_main) {
+    void (*main_fxn)() = (void (*)())main_sym->getAddress();
+    main_fxn();
+    *ret = 0;
+  }
+  else {
+    int (*main_fxn)() = (int (*)())main_sym->getAddress();
+    *ret = main_fxn();
+  }
+  chrono::steady_clock::time_point stop = chrono::steady_clock::now();
+  *seconds = chrono::duration<double>(stop - start).count();
+  return true;
+}
+
+bool foldConstant(NodeKind kind, int op, int left, int right, int *result) {
+  uint32_t l = (uint32_t)left, r = (uint32_t)right;
+  switch (kind) {
+  case _ARITHMATIC:
+    switch ((AriOp)op) {
+    case _ADD: *result = (int)(l + r); return true;
+    case _SUB: *result = (int)(l - r); return true;
+    case _MUL: *result = (int)(l * r); return true;
+    case _DIV:
+    case _MOD:
+      if (right == 0 || (left == INT32_MIN && right == -1))
+        return false;
+      *result = op == _DIV ? left / right : left % right;
+      return true;
+    }
+    return false;
+  case _BITWISE:
+    switch ((BitOp)op) {
+    case _AND: *result = (int)(l & r); return true;
+    case _OR:  *result = (int)(l | r); return true;
+    case _XOR: *result = (int)(l ^ r); return true;
+    case _LSHIFT:
+    case _RSHIFT:
+      if (right < 0 || right > 31)
+        return false;
+      // arithmetic right shift, like the generated ashr
+      *result = op == _LSHIFT ? (int)(l << right)
+                : (left < 0 ? (int)~(~l >> right) : (int)(l >> right));
+      return true;
+    }
+    return false;
+  case _COMPARISION:
+    switch ((CompOp)op) {
+    case _LT:   *result = left < right;  return true;
+    case _GT:   *result = left > right;  return true;
+    case _GEQ:  *result = left >= right; return true;
+    case _LEQ:  *result = left <= right; return true;
+    case _EQEQ: *result = left == right; return true;
+    case _NEQ:  *result = left != right; return true;
+    }
+    return false;
+  case _BOOLEAN:
+    if ((BoolOp)op == _ANDAND) *result = left != 0 && right != 0;
+    else *result = left != 0 || right != 0;
+    return true;
+  default:
+    return false;
+  }
+}
+
+// What precomputing knows about local variables at a program point.
+// A fact says that a variable holds a constant, or the same value as another
+// variable. Only locals of the current function get facts: nothing else can
+// write them behind our back.
+struct ConstFact {
+  bool is_const;
+  int value;       // is_const
+  Symbol copy_of;  // !is_const
+};
+
+struct PropagationState {
+  PropagationState() : in_function(false) {}
+  bool in_function;
+  map<Symbol, ConstFact> facts;
+  map<Symbol, int> locals; // open declarations per name
+
+  bool isLocal(Symbol s) {
+    map<Symbol, int>::iterator it = locals.find(s);
+    return it != locals.end() && it->second > 0;
+  }
+  // s changes (assignment or new declaration), drop what depended on it
+  void kill(Symbol s) {
+    facts.erase(s);
+    for (map<Symbol, ConstFact>::iterator it = facts.begin(); it != facts.end(); ) {
+      if (!it->second.is_const && it->second.copy_of == s)
+        facts.erase(it++);
+      else
+        ++it;
+    }
+  }
+  // control flow merge, keep the facts both paths agree on
+  void join(PropagationState &other) {
+    for (map<Symbol, ConstFact>::iterator it = facts.begin(); it != facts.end(); ) {
+      map<Symbol, ConstFact>::iterator o = other.facts.find(it->first);
+      bool same = o != other.facts.end() && o->second.is_const == it->second.is_const
+                  && (it->second.is_const ? o->second.value == it->second.value
+                                          : o->second.copy_of == it->second.copy_of);
+      if (same)
+        ++it;
+      else
+        facts.erase(it++);
+    }
+  }
+};
+
+static Node *precompute(Node *root, PropagationState &env);
+
+// symbols assigned anywhere below n
+static void collectAssigned(Node *n, vector<Symbol> &assigned) {
+  if (n == NULL) return;
+  switch (n->getKind()) {
+  case _ASSIGN: {
+    Assign *temp = static_cast<Assign *>(n);
+    if (IdentifierList *lhs = nodeCast<IdentifierList *>(temp->getLHS()))
+      assigned.push_back(lhs->getSymbol());
+    collectAssigned(temp->getRHS(), assigned);
+    break;
+  }
+  case _PROGRAM: {
+    vector<Node *> &nodes = static_cast<Program *>(n)->getNodes();
+    for (size_t i=0; i<nodes.size(); ++i) collectAssigned(nodes[i], assigned);
+    break;
+  }
+  case _BLOCK: {
+    vector<Node *> &nodes = static_cast<Block *>(n)->getStatements();
+    for (size_t i=0; i<nodes.size(); ++i) collectAssigned(nodes[i], assigned);
+    break;
+  }
+  case _PARAMETER_LIST: {
+    vector<Node *> &nodes = static_cast<ParameterList *>(n)->getParams();
+    for (size_t i=0; i<nodes.size(); ++i) collectAssigned(nodes[i], assigned);
+    break;
+  }
+  case _ARITHMATIC: {
+    Arithmatic *temp = static_cast<Arithmatic *>(n);
+    collectAssigned(temp->getLeft(), assigned);
+    collectAssigned(temp->getRight(), assigned);
+    break;
+  }
+  case _BITWISE: {
+    Bitwise *temp = static_cast<Bitwise *>(n);
+    collectAssigned(temp->getLeft(), assigned);
+    collectAssigned(temp->getRight(), assigned);
+    break;
+  }
+  case _COMPARISION: {
+    Comparision *temp = static_cast<Comparision *>(n);
+    collectAssigned(temp->getLeft(), assigned);
+    collectAssigned(temp->getRight(), assigned);
+    break;
+  }
+  case _BOOLEAN: {
+    Boolean *temp = static_cast<Boolean *>(n);
+    collectAssigned(temp->getLeft(), assigned);
+    collectAssigned(temp->getRight(), assigned);
+    break;
+  }
+  case _RETURN:
+    collectAssigned(static_cast<Return *>(n)->getNode(), assigned);
+    break;
+  case _FXN_CALL:
+    collectAssigned(static_cast<FxnCall *>(n)->getNode(), assigned);
+    break;
+  case _IF_THEN: {
+    IfThen *temp = static_cast<IfThen *>(n);
+    collectAssigned(temp->getCond(), assigned);
+    collectAssigned(temp->getIfBody(), assigned);
+    break;
+  }
+  case _IF_THEN_ELSE: {
+    IfThenElse *temp = static_cast<IfThenElse *>(n);
+    collectAssigned(temp->getCond(), assigned);
+    collectAssigned(temp->getIfBody(), assigned);
+    collectAssigned(temp->getElseBody(), assigned);
+    break;
+  }
+  case _WHILE: {
+    While *temp = static_cast<While *>(n);
+    collectAssigned(temp->getCond(), assigned);
+    collectAssigned(temp->getBody(), assigned);
+    break;
+  }
+  default:
+    break;
+  }
+}
+
+// control never gets past n, the statements after it are dead
+static bool alwaysReturns(Node *n) {
+  if (n == NULL) return false;
+  switch (n->getKind()) {
+  case _RETURN:
+    return true;
+  case _BLOCK: {
+    vector<Node *> &statements = static_cast<Block *>(n)->getStatements();
+    for (size_t i=0; i<statements.size(); ++i)
+      if (alwaysReturns(statements[i]))
+        return true;
+    return false;
+  }
+  case _IF_THEN_ELSE: {
+    IfThenElse *t = static_cast<IfThenElse *>(n);
+    return alwaysReturns(t->getIfBody()) && alwaysReturns(t->getElseBody());
+  }
+  default:
+    return false;
+  }
+}
+
+// no calls and no assignments below n, dropping or repeating it is harmless
+static bool isPure(Node *n) {
+  if (n == NULL) return true;
+  switch (n->getKind()) {
+  case _INT_CONST:
+  case _IDENTIFIER_LIST:
+    return true;
+  case _ARITHMATIC: {
+    Arithmatic *t = static_cast<Arithmatic *>(n);
+    return isPure(t->getLeft()) && isPure(t->getRight());
+  }
+  case _BITWISE: {
+    Bitwise *t = static_cast<Bitwise *>(n);
+    return isPure(t->getLeft()) && isPure(t->getRight());
+  }
+  case _COMPARISION: {
+    Comparision *t = static_cast<Comparision *>(n);
+    return isPure(t->getLeft()) && isPure(t->getRight());
+  }
+  case _BOOLEAN: {
+    Boolean *t = static_cast<Boolean *>(n);
+    return isPure(t->getLeft()) && isPure(t->getRight());
+  }
+  default:
+    return false;
+  }
+}
 
-  // dumping the llvm ir
-  module->print(*out, nullptr);
-  module->print(llvm::errs(), nullptr);
+// same value: structurally equal pure expressions
+static bool sameExpr(Node *a, Node *b) {
+  if (a == b) return isPure(a);
+  if (a == NULL || b == NULL || a->getKind() != b->getKind()) return false;
+  switch (a->getKind()) {
+  case _INT_CONST:
+    return static_cast<IntConst *>(a)->getVal() == static_cast<IntConst *>(b)->getVal();
+  case _IDENTIFIER_LIST: {
+    IdentifierList *x = static_cast<IdentifierList *>(a);
+    IdentifierList *y = static_cast<IdentifierList *>(b);
+    return x->getPointerCount() == 0 && y->getPointerCount() == 0
+           && x->getSymbols() == y->getSymbols();
+  }
+  case _ARITHMATIC: {
+    Arithmatic *x = static_cast<Arithmatic *>(a), *y = static_cast<Arithmatic *>(b);
+    return x->getOp() == y->getOp() && sameExpr(x->getLeft(), y->getLeft())
+           && sameExpr(x->getRight(), y->getRight());
+  }
+  case _BITWISE: {
+    Bitwise *x = static_cast<Bitwise *>(a), *y = static_cast<Bitwise *>(b);
+    return x->getOp() == y->getOp() && sameExpr(x->getLeft(), y->getLeft())
+           && sameExpr(x->getRight(), y->getRight());
+  }
+  case _COMPARISION: {
+    Comparision *x = static_cast<Comparision *>(a), *y = static_cast<Comparision *>(b);
+    return x->getOp() == y->getOp() && sameExpr(x->getLeft(), y->getLeft())
+           && sameExpr(x->getRight(), y->getRight());
+  }
+  default:
+    return false;
+  }
+}
 
-  if (out != &llvm::outs())
-    delete out;
+// value of n is >= 0 whatever its variables hold
+static bool isNonNegative(Node *n) {
+  switch (n->getKind()) {
+  case _INT_CONST:
+    return static_cast<IntConst *>(n)->getVal() >= 0;
+  case _COMPARISION:
+  case _BOOLEAN:
+    return true;
+  case _BITWISE: {
+    Bitwise *t = static_cast<Bitwise *>(n);
+    if (t->getOp() == _AND)
+      return isNonNegative(t->getLeft()) || isNonNegative(t->getRight());
+    if (t->getOp() == _RSHIFT)
+      return isNonNegative(t->getLeft());
+    return false;
+  }
+  case _ARITHMATIC: {
+    Arithmatic *t = static_cast<Arithmatic *>(n);
+    if (t->getOp() == _DIV || t->getOp() == _MOD)
+      return isNonNegative(t->getLeft()) && isNonNegative(t->getRight());
+    return false;
+  }
+  default:
+    return false;
+  }
+}
 
+// k when v == 2^k, -1 otherwise
+static int exactLog2(int v) {
+  for (int k=0; k<31; ++k)
+    if (v == (1 << k)) return k;
+  return -1;
+}
+
+// Identities and strength reduction on one Arithmatic or Bitwise node, NULL
+// if none applies. An operand is only dropped when it is pure.
+//   x+0 x-0 x*1 x/1 x|0 x^0 x<<0 x>>0 x&x x|x -> x
+//   x*0 x&0 x%1 x-x x^x -> 0
+//   x * 2^k -> x << k
+//   x / 2^k -> x >> k, x % 2^k -> x & (2^k-1)   for x >= 0 only
+static Node *simplifyBinary(NodeKind kind, int op, Node *left, Node *right) {
+  IntConst *lconst = nodeCast<IntConst *>(left);
+  IntConst *rconst = nodeCast<IntConst *>(right);
+  int r = rconst ? rconst->getVal() : 0;
+  int l = lconst ? lconst->getVal() : 0;
+  if (kind == _ARITHMATIC) {
+    switch ((AriOp)op) {
+    case _ADD:
+      if (rconst && r == 0) return left;
+      if (lconst && l == 0) return right;
+      break;
+    case _SUB:
+      if (rconst && r == 0) return left;
+      if (sameExpr(left, right)) return new IntConst(0);
+      break;
+    case _MUL:
+      if (rconst && r == 1) return left;
+      if (lconst && l == 1) return right;
+      if ((rconst && r == 0 && isPure(left)) || (lconst && l == 0 && isPure(right)))
+        return new IntConst(0);
+      if (rconst && exactLog2(r) > 0)
+        return new Bitwise(_LSHIFT, left, new IntConst(exactLog2(r)));
+      if (lconst && exactLog2(l) > 0)
+        return new Bitwise(_LSHIFT, right, new IntConst(exactLog2(l)));
+      break;
+    case _DIV:
+      if (rconst && r == 1) return left;
+      // an arithmetic shift rounds negative values the wrong way
+      if (rconst && exactLog2(r) > 0 && isNonNegative(left))
+        return new Bitwise(_RSHIFT, left, new IntConst(exactLog2(r)));
+      break;
+    case _MOD:
+      if (rconst && r == 1 && isPure(left)) return new IntConst(0);
+      if (rconst && exactLog2(r) > 0 && isNonNegative(left))
+        return new Bitwise(_AND, left, new IntConst(r - 1));
+      break;
+    }
+  }
+  else if (kind == _BITWISE) {
+    switch ((BitOp)op) {
+    case _AND:
+      if ((rconst && r == 0 && isPure(left)) || (lconst && l == 0 && isPure(right)))
+        return new IntConst(0);
+      if (rconst && r == -1) return left;
+      if (lconst && l == -1) return right;
+      if (sameExpr(left, right)) return left;
+      break;
+    case _OR:
+      if (rconst && r == 0) return left;
+      if (lconst && l == 0) return right;
+      if (sameExpr(left, right)) return left;
+      break;
+    case _XOR:
+      if (rconst && r == 0) return left;
+      if (lconst && l == 0) return right;
+      if (sameExpr(left, right)) return new IntConst(0);
+      break;
+    case _LSHIFT:
+    case _RSHIFT:
+      if (rconst && r == 0) return left;
+      break;
+    }
+  }
+  return NULL;
+}
+
+// fold a binary operator node whose operands are (now) constants. With only
+// the left operand constant, && and || still fold where C would not look at
+// the right one, or reduce to the right one compared against 0.
+static Node *precomputeBinary(Node *root, int op, Node *left, Node *right,
+                              PropagationState &env) {
+  Node *left_opt = precompute(left, env);
+  Node *right_opt;
+  if (root->getKind() == _BOOLEAN) {
+    // the right operand may not run
+    PropagationState right_env = env;
+    right_opt = precompute(right, right_env);
+    env.join(right_env);
+  }
+  else
+    right_opt = precompute(right, env);
+  IntConst *lconst = nodeCast<IntConst *>(left_opt);
+  IntConst *rconst = nodeCast<IntConst *>(right_opt);
+  int result;
+  if (lconst != NULL && rconst != NULL &&
+      foldConstant(root->getKind(), op, lconst->getVal(), rconst->getVal(), &result))
+    return new IntConst(result);
+  if (root->getKind() == _BOOLEAN && lconst != NULL) {
+    bool lval = lconst->getVal() != 0;
+    if (((BoolOp)op == _ANDAND) != lval)
+      return new IntConst(lval);  // 0 && x, 1 || x
+    return new Comparision(_NEQ, right_opt, new IntConst(0));
+  }
+  if (Node *simple = simplifyBinary(root->getKind(), op, left_opt, right_opt))
+    return simple;
+  if (left_opt == left && right_opt == right)
+    return root;
+  switch (root->getKind()) {
+  case _ARITHMATIC:  return new Arithmatic((AriOp)op, left_opt, right_opt);
+  case _BITWISE:     return new Bitwise((BitOp)op, left_opt, right_opt);
+  case _COMPARISION: return new Comparision((CompOp)op, left_opt, right_opt);
+  default:           return new Boolean((BoolOp)op, left_opt, right_opt);
+  }
+}
+
+// precompute every node of nodes, false (and nodes untouched) if none changed
+static bool precomputeList(vector<Node *> &nodes, vector<Node *> &result,
+                           PropagationState &env) {
+  int size = nodes.size();
+  for (int i=0; i<size; ++i) {
+    Node *curr = precompute(nodes[i], env);
+    if (curr == nodes[i]) continue;
+    // first change, copy the prefix once and keep going
+    result.reserve(size);
+    result.assign(nodes.begin(), nodes.begin() + i);
+    result.push_back(curr);
+    for (++i; i<size; ++i)
+      result.push_back(precompute(nodes[i], env));
+    return true;
+  }
+  return false;
 }
 
 // const int propagation
 /*
  * old code:
- *            return 1+2*3;
+ *            int a;
+ *            a = 1+2*3;
+ *            return a*2;
  *
  * new code:
- *            return 7;
+ *            int a;
+ *            a = 7;
+ *            return 14;
+ *
+ * Facts about locals flow forward through the statements of a block, the
+ * two arms of an if are joined afterwards and a while forgets everything
+ * its body assigns before looking at the condition.
+ *
+ * Copy on write: a node is returned as is when nothing below it folded, new
+ * nodes are only made on the path from a folded expression to the root.
  */
 Node *precomputing(Node *root) {
-  // replace IdentifierList(a) with IntConst(value);
-  if (IntConst *temp = dynamic_cast<IntConst *>(root)) {
-    return temp->getCopy();
-  }
-  else if (StrConst *temp = dynamic_cast<StrConst *>(root)) {
-    return temp->getCopy();
+  PropagationState env;
+  return precompute(root, env);
+}
+
+static Node *precompute(Node *root, PropagationState &env) {
+  if (root == NULL) return nullptr;
+  switch (root->getKind()) {
+  case _INT_CONST:
+  case _STR_CONST:
+  case _IDENTIFIER:
+  case _TYPE:
+  case _DECLARATION:
+    return root;
+  case _IDENTIFIER_LIST: {
+    // replace IdentifierList(a) with IntConst(value) or the variable it copies
+    IdentifierList *temp = static_cast<IdentifierList *>(root);
+    if (temp->getSymbols().size() != 1 || temp->getPointerCount() != 0)
+      return root;
+    map<Symbol, ConstFact>::iterator fact = env.facts.find(temp->getSymbol());
+    if (fact == env.facts.end())
+      return root;
+    if (fact->second.is_const)
+      return new IntConst(fact->second.value);
+    return new IdentifierList(fact->second.copy_of);
   }
-  else if (Program *temp = dynamic_cast<Program *>(root)) {
-    vector<Node *> prog_nodes = temp->getNodes();
+  case _PROGRAM: {
+    Program *temp = static_cast<Program *>(root);
+    vector<Node *> prog_nodes;
+    if (!precomputeList(temp->getNodes(), prog_nodes, env))
+      return root;
     Program *new_program = new Program();
     int size = prog_nodes.size();
-    for (int i=0; i<size; ++i) {
-      Node *curr = precomputing(prog_nodes[i]);
-      new_program->addNode(curr);
-    }
+    for (int i=0; i<size; ++i)
+      new_program->addNode(prog_nodes[i]);
     return new_program;
   }
-  else if (Arithmatic *temp = dynamic_cast<Arithmatic *>(root)) {
-    AriOp op = temp->getOp();
-    Node *left = temp->getLeft();
-    Node *right = temp->getRight();
-    Node *left_node = precomputing(left);
-    Node *right_node = precomputing(right);
-    IntConst *left_opt = dynamic_cast<IntConst *>(left_node);
-    IntConst *right_opt = dynamic_cast<IntConst *>(right_node);
-    if (left_opt != NULL && right_opt!=NULL) {
-      int ileft = left_opt->getVal();
-      int iright = right_opt->getVal();
-      int result;
-      if (op == _ADD) result = ileft + iright;
-      else if (op == _SUB) result = ileft - iright;
-      else if (op == _MUL) result = ileft * iright;
-      else if (op == _DIV) result = ileft / iright;
-      else if (op == _MOD) result = ileft % iright;
-      return new IntConst(result);
-    }
-    return new Arithmatic(op, left_node, right_node);
-  }
-  else if (Bitwise *temp = dynamic_cast<Bitwise *>(root)) {
-    Node *left = temp->getLeft();
-    Node *right = temp->getRight();
-    BitOp op = temp->getOp();
-    Node *left_opt = precomputing(left);
-    Node *right_opt = precomputing(right);
-    return new Bitwise(op, left_opt, right_opt);
+  case _ARITHMATIC: {
+    Arithmatic *temp = static_cast<Arithmatic *>(root);
+    return precomputeBinary(root, temp->getOp(), temp->getLeft(), temp->getRight(), env);
   }
-  else if (Comparision *temp = dynamic_cast<Comparision *>(root)) {
-    Node *left = temp->getLeft();
-    Node *right = temp->getRight();
-    CompOp op = temp->getOp();
-    Node *left_opt = precomputing(left);
-    Node *right_opt = precomputing(right);
-    return new Comparision(op, left_opt, right_opt);
+  case _BITWISE: {
+    Bitwise *temp = static_cast<Bitwise *>(root);
+    return precomputeBinary(root, temp->getOp(), temp->getLeft(), temp->getRight(), env);
   }
-  else if (Boolean * temp = dynamic_cast<Boolean *>(root)) {
-    Node *left = temp->getLeft();
-    Node *right = temp->getRight();
-    BoolOp op = temp->getOp();
-    Node *left_opt = precomputing(left);
-    Node *right_opt = precomputing(right);
-    return new Boolean(op, left_opt, right_opt);
+  case _COMPARISION: {
+    Comparision *temp = static_cast<Comparision *>(root);
+    return precomputeBinary(root, temp->getOp(), temp->getLeft(), temp->getRight(), env);
   }
-  else if (Assign *temp = dynamic_cast<Assign *>(root)) {
+  case _BOOLEAN: {
+    Boolean *temp = static_cast<Boolean *>(root);
+    return precomputeBinary(root, temp->getOp(), temp->getLeft(), temp->getRight(), env);
+  }
+  case _ASSIGN: {
+    // the lhs is never substituted, it is the variable being written
+    Assign *temp = static_cast<Assign *>(root);
     Node *lhs = temp->getLHS();
     Node *rhs = temp->getRHS();
-    Node *lhs_new = precomputing(lhs);
-    Node *rhs_new = precomputing(rhs);
-    return new Assign(lhs_new, rhs_new);
+    Node *rhs_new = precompute(rhs, env);
+    IdentifierList *var = nodeCast<IdentifierList *>(lhs);
+    if (var != NULL) {
+      Symbol s = var->getSymbol();
+      env.kill(s);
+      IntConst *c = nodeCast<IntConst *>(rhs_new);
+      IdentifierList *src = nodeCast<IdentifierList *>(rhs_new);
+      if (env.isLocal(s) && c != NULL) {
+        ConstFact f = {true, c->getVal(), 0};
+        env.facts[s] = f;
+      }
+      else if (env.isLocal(s) && src != NULL && src->getPointerCount() == 0 &&
+               src->getSymbol() != s && env.isLocal(src->getSymbol())) {
+        ConstFact f = {false, 0, src->getSymbol()};
+        env.facts[s] = f;
+      }
+    }
+    if (rhs_new == rhs)
+      return root;
+    return new Assign(lhs, rhs_new);
   }
-  else if (Block *temp = dynamic_cast<Block *>(root)) {
-    vector<Node *> statement_seq = temp->getStatements();
-    int size = statement_seq.size();
-    Block *new_block = new Block();
+  case _BLOCK: {
+    Block *temp = static_cast<Block *>(root);
+    vector<Node *> &statements = temp->getStatements();
+    int size = statements.size();
+    // locals declared here shadow outer ones until the block ends
+    vector<pair<Symbol, ConstFact> > shadowed;
+    vector<Symbol> declared;
+    vector<Node *> statement_seq;
+    bool changed = false;
     for (int i=0; i<size; ++i) {
-      Node *statement = precomputing(statement_seq[i]);
-      new_block->addNode(statement);
+      FDeclaration *decl = nodeCast<FDeclaration *>(statements[i]);
+      IdentifierList *var = decl ? nodeCast<IdentifierList *>(decl->getNameArg()) : NULL;
+      if (var != NULL && env.in_function) {
+        Symbol s = var->getSymbol();
+        // a constant stays true while hidden, a copy might not
+        map<Symbol, ConstFact>::iterator fact = env.facts.find(s);
+        if (fact != env.facts.end() && fact->second.is_const)
+          shadowed.push_back(make_pair(s, fact->second));
+        env.kill(s);
+        env.locals[s]++;
+        declared.push_back(s);
+      }
+      Node *statement = precompute(statements[i], env);
+      if (statement != statements[i] && !changed) {
+        changed = true;
+        statement_seq.assign(statements.begin(), statements.begin() + i);
+      }
+      if (changed)
+        statement_seq.push_back(statement);
+      // a branch folded away may leave a return in the middle of the block
+      if (i + 1 < size && alwaysReturns(statement)) {
+        if (!changed) {
+          changed = true;
+          statement_seq.assign(statements.begin(), statements.begin() + i + 1);
+        }
+        break;
+      }
     }
+    for (int i=declared.size()-1; i>=0; --i) {
+      env.kill(declared[i]);
+      env.locals[declared[i]]--;
+    }
+    for (int i=shadowed.size()-1; i>=0; --i)
+      env.facts[shadowed[i].first] = shadowed[i].second;
+    if (!changed)
+      return root;
+    Block *new_block = new Block();
+    for (size_t i=0; i<statement_seq.size(); ++i)
+      new_block->addNode(statement_seq[i]);
     return new_block;
   }
-  else if (Identifier *temp = dynamic_cast<Identifier *>(root)) {
-    return temp->getCopy();
-  }
-  else if (IdentifierList *temp = dynamic_cast<IdentifierList *>(root)) {
-    return temp->getCopy();
-  }
-  else if (Type *temp = dynamic_cast<Type *>(root)) {
-    return temp->getCopy();
-  }
-  else if (Declaration *temp = dynamic_cast<Declaration *>(root)) {
-    return temp->getCopy();
-  }
-  else if (ParameterList *temp = dynamic_cast<ParameterList *>(root)) {
-    vector<Node *> params = temp->getParams();
-    int size = params.size();
+  case _PARAMETER_LIST: {
+    ParameterList *temp = static_cast<ParameterList *>(root);
+    vector<Node *> params;
+    if (!precomputeList(temp->getParams(), params, env))
+      return root;
     ParameterList *new_pl = new ParameterList();
-    for (int i=0; i<size; ++i) {
-      Node *new_param = precomputing(params[i]);
-      new_pl->addNode(new_param);
-    }
+    int size = params.size();
+    for (int i=0; i<size; ++i)
+      new_pl->addNode(params[i]);
     return new_pl;
   }
-  else if (FxnNameArg *temp = dynamic_cast<FxnNameArg *>(root)) {
-    string fxn_name = temp->getFxnName();
-    Node *arg_list = temp->getArgList();
-    ParameterList *new_arg_list = dynamic_cast<ParameterList *>(
-                                    precomputing(arg_list));
-    return new FxnNameArg(fxn_name, new_arg_list);
-  }
-  else if (FxnDef *temp = dynamic_cast<FxnDef *>(root)) {
-    Node *ret_type = temp->getType();
-    Node *name_arg = temp->getFxnNameArg();
-    Node *body = temp->getBody();
-    
-    Type *new_ret_type = dynamic_cast<Type *>(precomputing(ret_type));
-    FxnNameArg *new_name_arg = dynamic_cast<FxnNameArg *>(precomputing(name_arg));
-    Block *new_body = dynamic_cast<Block *>(precomputing(body));
-
-    return new FxnDef(new_ret_type, new_name_arg, new_body);
-  }
-  else if (FDeclaration *temp = dynamic_cast<FDeclaration *>(root)) {
-    Node *ret_type = temp->getRetType();
-    Node *name_arg = temp->getNameArg();
-
-    Node *new_ret_type = precomputing(ret_type);
-    Node *new_name_arg = precomputing(name_arg);
-
-    return new FDeclaration(new_ret_type, new_name_arg);
+  case _FXN_NAME_ARG:
+    // only declarations in here, nothing to fold
+    return root;
+  case _FXN_DEF: {
+    FxnDef *temp = static_cast<FxnDef *>(root);
+    // every function starts from scratch, parameters are locals
+    PropagationState fxn_env;
+    fxn_env.in_function = true;
+    vector<Symbol> args = temp->getArgSymbols();
+    for (size_t i=0; i<args.size(); ++i)
+      fxn_env.locals[args[i]]++;
+    Block *body = temp->getBody();
+    Block *new_body = nodeCast<Block *>(precompute(body, fxn_env));
+    if (new_body == body)
+      return root;
+    return new FxnDef(temp->getType(), temp->getFxnNameArg(), new_body);
   }
-  else if (FxnCall *temp = dynamic_cast<FxnCall *>(root)) {
-    string fxn_name = temp->getFxnName();
+  case _F_DECLARATION:
+    return root;
+  case _FXN_CALL: {
+    FxnCall *temp = static_cast<FxnCall *>(root);
     Node *values = temp->getNode();
-
-    Node *new_values = precomputing(values);
-    return new FxnCall(fxn_name, new_values);
+    Node *new_values = precompute(values, env);
+    if (new_values == values)
+      return root;
+    return new FxnCall(temp->getFxnSymbol(), new_values);
   }
-  else if (Return *temp = dynamic_cast<Return *>(root)) {
+  case _RETURN: {
+    Return *temp = static_cast<Return *>(root);
     Node *ret_node = temp->getNode();
-    if (ret_node == NULL)
-      return new Return();
-    Node *new_ret_node = precomputing(ret_node);
+    Node *new_ret_node = precompute(ret_node, env);
+    if (new_ret_node == ret_node)
+      return root;
     return new Return(new_ret_node);
   }
-  else if (IfThen *temp = dynamic_cast<IfThen *>(root)) {
+  case _IF_THEN: {
+    IfThen *temp = static_cast<IfThen *>(root);
     Node *cond = temp->getCond();
     Node *body = temp->getIfBody();
 
-    Node *new_cond = precomputing(cond);
-    Node *new_body = precomputing(body);
+    Node *new_cond = precompute(cond, env);
+    // constant condition, keep the body or nothing
+    if (IntConst *c = nodeCast<IntConst *>(new_cond))
+      return c->getVal() != 0 ? precompute(body, env) : new Block();
+    PropagationState body_env = env;
+    Node *new_body = precompute(body, body_env);
+    env.join(body_env);
+    if (new_cond == cond && new_body == body)
+      return root;
     return new IfThen(new_cond, new_body);
   }
-  else if (IfThenElse *temp = dynamic_cast<IfThenElse *>(root)) {
+  case _IF_THEN_ELSE: {
+    IfThenElse *temp = static_cast<IfThenElse *>(root);
     Node *cond = temp->getCond();
     Node *if_body = temp->getIfBody();
     Node *else_body = temp->getElseBody();
 
-    Node *new_cond = precomputing(cond);
-    Node *new_if_body = precomputing(if_body);
-    Node *new_else_body = precomputing(else_body);
+    Node *new_cond = precompute(cond, env);
+    if (IntConst *c = nodeCast<IntConst *>(new_cond))
+      return precompute(c->getVal() != 0 ? if_body : else_body, env);
+    PropagationState else_env = env;
+    Node *new_if_body = precompute(if_body, env);
+    Node *new_else_body = precompute(else_body, else_env);
+    env.join(else_env);
+    if (new_cond == cond && new_if_body == if_body && new_else_body == else_body)
+      return root;
     return new IfThenElse(new_cond, new_if_body, new_else_body);
   }
-  else if (While *temp = dynamic_cast<While *>(root)) {
+  case _WHILE: {
+    While *temp = static_cast<While *>(root);
     Node *cond = temp->getCond();
     Node *body = temp->getBody();
 
-    Node *new_cond = precomputing(cond);
-    Node *new_body = precomputing(body);
+    // the back edge brings whatever the body assigns back to the condition
+    vector<Symbol> assigned;
+    collectAssigned(root, assigned);
+    for (size_t i=0; i<assigned.size(); ++i)
+      env.kill(assigned[i]);
+    Node *new_cond = precompute(cond, env);
+    // while (0) never runs, while (1) stays a loop
+    IntConst *c = nodeCast<IntConst *>(new_cond);
+    if (c != NULL && c->getVal() == 0)
+      return new Block();
+    PropagationState body_env = env;
+    Node *new_body = precompute(body, body_env);
+    if (new_cond == cond && new_body == body)
+      return root;
     return new While(new_cond, new_body);
   }
-  else return nullptr;
+  default: return nullptr;
+  }
+}
+
+// Inlining of small helper functions, done on the AST before precomputing so
+// that the constants of a call site fold into the callee body.
+//
+// A function qualifies when its body only touches its parameters and its own
+// locals, calls nothing and returns once, as its last statement. Running such
+// a body cannot change anything else, so a call is replaced by the body run
+// right before the statement that holds the call:
+//
+//   y = sq(x + 1);     ->   int sq.ret.2;
+//                           { int sq.a.1; sq.a.1 = x + 1;
+//                             sq.ret.2 = sq.a.1 * sq.a.1; }
+//                           y = sq.ret.2;
+//
+// Parameters and locals are renamed ('.' never appears in a C name).
+// Callees are handled before their callers, a helper that only calls other
+// helpers is call free afterwards and qualifies too. A recursive function
+// always keeps a call, it is never inlined.
+static const int INLINE_LIMIT = 40;       // nodes in the callee body
+static const int INLINE_CONST_BONUS = 10; // per constant argument
+static const int INLINE_GROWTH = 400;     // nodes inlined into one function
+
+struct InlineState {
+  InlineState() : fresh_count(0), growth(0) {}
+  map<Symbol, FxnDef *> defs;  // current body of every function
+  map<Symbol, int> costs;      // body size when it can be inlined, else -1
+  map<Symbol, int> visit;      // 1 while the function is rewritten, 2 after
+  int fresh_count;
+  int growth;                  // nodes inlined into the current function
+};
+
+static void inlineFunction(Symbol name, InlineState &st);
+
+static int addCost(int a, int b) {
+  return (a < 0 || b < 0) ? -1 : a + b;
+}
+
+static bool isBound(Symbol s, vector<Symbol> &bound) {
+  return find(bound.begin(), bound.end(), s) != bound.end();
+}
+
+static int inlineBodyCost(Node *n, vector<Symbol> &bound);
+
+// cost of the first count statements, their declarations are added to bound
+static int inlineStatementsCost(vector<Node *> &statements, int count,
+                                vector<Symbol> &bound) {
+  int cost = 0;
+  for (int i=0; i<count && cost >= 0; ++i) {
+    FDeclaration *decl = nodeCast<FDeclaration *>(statements[i]);
+    if (decl != NULL) {
+      IdentifierList *var = nodeCast<IdentifierList *>(decl->getNameArg());
+      if (var == NULL || var->getPointerCount() != 0)
+        return -1;
+      bound.push_back(var->getSymbol());
+      cost += 1;
+    }
+    else
+      cost = addCost(cost, inlineBodyCost(statements[i], bound));
+  }
+  return cost;
+}
+
+// nodes below n when it may be part of an inlined body, -1 otherwise.
+// bound holds the parameters and the locals in scope.
+static int inlineBodyCost(Node *n, vector<Symbol> &bound) {
+  if (n == NULL) return 0;
+  switch (n->getKind()) {
+  case _INT_CONST:
+    return 1;
+  case _IDENTIFIER_LIST: {
+    IdentifierList *t = static_cast<IdentifierList *>(n);
+    if (t->getSymbols().size() != 1 || t->getPointerCount() != 0)
+      return -1;
+    return isBound(t->getSymbol(), bound) ? 1 : -1;
+  }
+  case _ARITHMATIC: {
+    Arithmatic *t = static_cast<Arithmatic *>(n);
+    return addCost(1, addCost(inlineBodyCost(t->getLeft(), bound),
+                              inlineBodyCost(t->getRight(), bound)));
+  }
+  case _BITWISE: {
+    Bitwise *t = static_cast<Bitwise *>(n);
+    return addCost(1, addCost(inlineBodyCost(t->getLeft(), bound),
+                              inlineBodyCost(t->getRight(), bound)));
+  }
+  case _COMPARISION: {
+    Comparision *t = static_cast<Comparision *>(n);
+    return addCost(1, addCost(inlineBodyCost(t->getLeft(), bound),
+                              inlineBodyCost(t->getRight(), bound)));
+  }
+  case _BOOLEAN: {
+    Boolean *t = static_cast<Boolean *>(n);
+    return addCost(1, addCost(inlineBodyCost(t->getLeft(), bound),
+                              inlineBodyCost(t->getRight(), bound)));
+  }
+  case _ASSIGN: {
+    Assign *t = static_cast<Assign *>(n);
+    if (nodeCast<IdentifierList *>(t->getLHS()) == NULL)
+      return -1;
+    return addCost(1, addCost(inlineBodyCost(t->getLHS(), bound),
+                              inlineBodyCost(t->getRHS(), bound)));
+  }
+  case _BLOCK: {
+    vector<Node *> &statements = static_cast<Block *>(n)->getStatements();
+    size_t mark = bound.size();
+    int cost = inlineStatementsCost(statements, statements.size(), bound);
+    bound.resize(mark);
+    return cost;
+  }
+  case _IF_THEN: {
+    IfThen *t = static_cast<IfThen *>(n);
+    return addCost(1, addCost(inlineBodyCost(t->getCond(), bound),
+                              inlineBodyCost(t->getIfBody(), bound)));
+  }
+  case _IF_THEN_ELSE: {
+    IfThenElse *t = static_cast<IfThenElse *>(n);
+    int cost = addCost(inlineBodyCost(t->getCond(), bound),
+                       inlineBodyCost(t->getIfBody(), bound));
+    return addCost(1, addCost(cost, inlineBodyCost(t->getElseBody(), bound)));
+  }
+  case _WHILE: {
+    While *t = static_cast<While *>(n);
+    return addCost(1, addCost(inlineBodyCost(t->getCond(), bound),
+                              inlineBodyCost(t->getBody(), bound)));
+  }
+  default:
+    // calls, returns before the end, strings, ...
+    return -1;
+  }
+}
+
+// size of the body of f, -1 if f can not be inlined
+static int inlineCost(FxnDef *f) {
+  vector<Symbol> bound = f->getArgSymbols();
+  vector<Node *> &statements = f->getBody()->getStatements();
+  int size = statements.size();
+  Return *ret = size > 0 ? nodeCast<Return *>(statements[size-1]) : NULL;
+  if (f->getRetType() == _VOID) {
+    if (ret != NULL) return -1;
+    return inlineStatementsCost(statements, size, bound);
+  }
+  if (ret == NULL || ret->getNode() == NULL)
+    return -1;
+  int cost = inlineStatementsCost(statements, size - 1, bound);
+  return addCost(cost, inlineBodyCost(ret->getNode(), bound));
+}
+
+// callee of call if it may be expanded at this call site, NULL otherwise.
+// Constant arguments raise the limit, they are likely to fold away.
+static FxnDef *inlineTarget(FxnCall *call, bool need_value, InlineState &st) {
+  Symbol name = call->getFxnSymbol();
+  map<Symbol, FxnDef *>::iterator def = st.defs.find(name);
+  if (def == st.defs.end())
+    return NULL;
+  if (st.visit[name] == 0)
+    inlineFunction(name, st);
+  map<Symbol, int>::iterator cost = st.costs.find(name);
+  // no cost yet: the call is part of a recursion
+  if (cost == st.costs.end() || cost->second < 0)
+    return NULL;
+  FxnDef *callee = st.defs[name];
+  if (need_value && callee->getRetType() == _VOID)
+    return NULL;
+  ParameterList *args = nodeCast<ParameterList *>(call->getNode());
+  if (args == NULL || args->getParams().size() != callee->getArgSymbols().size())
+    return NULL;
+  int limit = INLINE_LIMIT;
+  vector<Node *> &arg_nodes = args->getParams();
+  for (size_t i=0; i<arg_nodes.size(); ++i)
+    if (nodeCast<IntConst *>(arg_nodes[i]) != NULL)
+      limit += INLINE_CONST_BONUS;
+  return cost->second <= limit ? callee : NULL;
+}
+
+// nodes inlined when every call in e is expanded, 0 if there is no call and
+// -1 if the calls can not all be moved in front of the statement: only the
+// outermost call may stay, nothing may be assigned and the rhs of && and ||
+// must not call anything, it does not always run.
+static int hoistCost(Node *e, bool root, bool need_value, InlineState &st) {
+  if (e == NULL) return 0;
+  switch (e->getKind()) {
+  case _ARITHMATIC: {
+    Arithmatic *t = static_cast<Arithmatic *>(e);
+    return addCost(hoistCost(t->getLeft(), false, true, st),
+                   hoistCost(t->getRight(), false, true, st));
+  }
+  case _BITWISE: {
+    Bitwise *t = static_cast<Bitwise *>(e);
+    return addCost(hoistCost(t->getLeft(), false, true, st),
+                   hoistCost(t->getRight(), false, true, st));
+  }
+  case _COMPARISION: {
+    Comparision *t = static_cast<Comparision *>(e);
+    return addCost(hoistCost(t->getLeft(), false, true, st),
+                   hoistCost(t->getRight(), false, true, st));
+  }
+  case _BOOLEAN: {
+    Boolean *t = static_cast<Boolean *>(e);
+    if (hoistCost(t->getRight(), false, true, st) != 0)
+      return -1;
+    return hoistCost(t->getLeft(), false, true, st);
+  }
+  case _ASSIGN:
+    return -1;
+  case _FXN_CALL: {
+    FxnCall *call = static_cast<FxnCall *>(e);
+    FxnDef *callee = inlineTarget(call, need_value, st);
+    if (callee == NULL && !root)
+      return -1;
+    int cost = callee != NULL ? st.costs[callee->getFxnSymbol()] : 0;
+    ParameterList *args = nodeCast<ParameterList *>(call->getNode());
+    if (args == NULL)
+      return cost;
+    vector<Node *> &arg_nodes = args->getParams();
+    for (size_t i=0; i<arg_nodes.size(); ++i)
+      cost = addCost(cost, hoistCost(arg_nodes[i], false, true, st));
+    return cost;
+  }
+  default:
+    return 0;
+  }
+}
+
+// name for a renamed local of fxn, never equal to a source identifier
+static Symbol freshSymbol(StringRef fxn, StringRef var, InlineState &st) {
+  string name = fxn.str() + "." + var.str() + "." + to_string(++st.fresh_count);
+  return Interner::current()->intern(name);
+}
+
+struct InlineRenames {
+  StringRef fxn;
+  vector<pair<Symbol, Symbol> > names; // innermost last
+  Symbol lookup(Symbol s) {
+    for (size_t i=names.size(); i>0; --i)
+      if (names[i-1].first == s) return names[i-1].second;
+    return s;
+  }
+};
+
+static Node *cloneRenamed(Node *n, InlineRenames &renames, InlineState &st);
+
+// copy the first count statements into block, declarations get fresh names
+static void cloneStatements(vector<Node *> &statements, int count, Block *block,
+                            InlineRenames &renames, InlineState &st) {
+  Interner *names = Interner::current();
+  for (int i=0; i<count; ++i) {
+    FDeclaration *decl = nodeCast<FDeclaration *>(statements[i]);
+    if (decl != NULL) {
+      Symbol s = decl->getVarSymbol();
+      Symbol fresh = freshSymbol(renames.fxn, names->str(s), st);
+      renames.names.push_back(make_pair(s, fresh));
+      block->addNode(new FDeclaration(decl->getRetType(), new IdentifierList(fresh)));
+    }
+    else
+      block->addNode(cloneRenamed(statements[i], renames, st));
+  }
+}
+
+// copy of a node of an inlinable body (see inlineBodyCost), locals renamed
+static Node *cloneRenamed(Node *n, InlineRenames &renames, InlineState &st) {
+  if (n == NULL) return nullptr;
+  switch (n->getKind()) {
+  case _IDENTIFIER_LIST:
+    return new IdentifierList(renames.lookup(static_cast<IdentifierList *>(n)->getSymbol()));
+  case _ARITHMATIC: {
+    Arithmatic *t = static_cast<Arithmatic *>(n);
+    return new Arithmatic(t->getOp(), cloneRenamed(t->getLeft(), renames, st),
+                          cloneRenamed(t->getRight(), renames, st));
+  }
+  case _BITWISE: {
+    Bitwise *t = static_cast<Bitwise *>(n);
+    return new Bitwise(t->getOp(), cloneRenamed(t->getLeft(), renames, st),
+                       cloneRenamed(t->getRight(), renames, st));
+  }
+  case _COMPARISION: {
+    Comparision *t = static_cast<Comparision *>(n);
+    return new Comparision(t->getOp(), cloneRenamed(t->getLeft(), renames, st),
+                           cloneRenamed(t->getRight(), renames, st));
+  }
+  case _BOOLEAN: {
+    Boolean *t = static_cast<Boolean *>(n);
+    return new Boolean(t->getOp(), cloneRenamed(t->getLeft(), renames, st),
+                       cloneRenamed(t->getRight(), renames, st));
+  }
+  case _ASSIGN: {
+    Assign *t = static_cast<Assign *>(n);
+    return new Assign(cloneRenamed(t->getLHS(), renames, st),
+                      cloneRenamed(t->getRHS(), renames, st));
+  }
+  case _BLOCK: {
+    vector<Node *> &statements = static_cast<Block *>(n)->getStatements();
+    size_t mark = renames.names.size();
+    Block *block = new Block();
+    cloneStatements(statements, statements.size(), block, renames, st);
+    renames.names.resize(mark);
+    return block;
+  }
+  case _IF_THEN: {
+    IfThen *t = static_cast<IfThen *>(n);
+    return new IfThen(cloneRenamed(t->getCond(), renames, st),
+                      cloneRenamed(t->getIfBody(), renames, st));
+  }
+  case _IF_THEN_ELSE: {
+    IfThenElse *t = static_cast<IfThenElse *>(n);
+    return new IfThenElse(cloneRenamed(t->getCond(), renames, st),
+                          cloneRenamed(t->getIfBody(), renames, st),
+                          cloneRenamed(t->getElseBody(), renames, st));
+  }
+  case _WHILE: {
+    While *t = static_cast<While *>(n);
+    return new While(cloneRenamed(t->getCond(), renames, st),
+                     cloneRenamed(t->getBody(), renames, st));
+  }
+  default:
+    // constants are never changed, they can be shared
+    return n;
+  }
+}
+
+// append the body of callee run on args to prelude. Returns the variable
+// that holds the result, NULL when it is not wanted or there is none.
+static Node *expandCall(FxnDef *callee, vector<Node *> &args, bool want_value,
+                        vector<Node *> &prelude, InlineState &st) {
+  Interner *names = Interner::current();
+  InlineRenames renames;
+  renames.fxn = names->str(callee->getFxnSymbol());
+  Block *body = new Block();
+  ParameterList *params = nodeCast<ParameterList *>(callee->getFxnNameArg()->getArgList());
+  vector<Node *> &param_nodes = params->getParams();
+  for (size_t i=0; i<param_nodes.size(); ++i) {
+    Declaration *param = nodeCast<Declaration *>(param_nodes[i]);
+    Symbol fresh = freshSymbol(renames.fxn, names->str(param->getSymbol()), st);
+    renames.names.push_back(make_pair(param->getSymbol(), fresh));
+    body->addNode(new FDeclaration(param->getTypeNode(), new IdentifierList(fresh)));
+    body->addNode(new Assign(new IdentifierList(fresh), args[i]));
+  }
+  vector<Node *> &statements = callee->getBody()->getStatements();
+  int size = statements.size();
+  Return *ret = callee->getRetType() == _VOID ? NULL : nodeCast<Return *>(statements[size-1]);
+  cloneStatements(statements, ret != NULL ? size - 1 : size, body, renames, st);
+  Node *result = NULL;
+  // the return value is pure, it is dropped when nobody reads it
+  if (ret != NULL && want_value) {
+    Symbol r = freshSymbol(renames.fxn, "ret", st);
+    prelude.push_back(new FDeclaration(callee->getType(), new IdentifierList(r)));
+    body->addNode(new Assign(new IdentifierList(r), cloneRenamed(ret->getNode(), renames, st)));
+    result = new IdentifierList(r);
+  }
+  prelude.push_back(body);
+  st.growth += st.costs[callee->getFxnSymbol()];
+  return result;
+}
+
+// e with every call expanded into prelude, hoistCost(e) must be >= 0.
+// The outermost call stays a call when it can not be expanded.
+static Node *expandExpr(Node *e, bool need_value, vector<Node *> &prelude,
+                        InlineState &st) {
+  if (e == NULL) return nullptr;
+  switch (e->getKind()) {
+  case _ARITHMATIC: {
+    Arithmatic *t = static_cast<Arithmatic *>(e);
+    Node *l = expandExpr(t->getLeft(), true, prelude, st);
+    Node *r = expandExpr(t->getRight(), true, prelude, st);
+    if (l == t->getLeft() && r == t->getRight()) return e;
+    return new Arithmatic(t->getOp(), l, r);
+  }
+  case _BITWISE: {
+    Bitwise *t = static_cast<Bitwise *>(e);
+    Node *l = expandExpr(t->getLeft(), true, prelude, st);
+    Node *r = expandExpr(t->getRight(), true, prelude, st);
+    if (l == t->getLeft() && r == t->getRight()) return e;
+    return new Bitwise(t->getOp(), l, r);
+  }
+  case _COMPARISION: {
+    Comparision *t = static_cast<Comparision *>(e);
+    Node *l = expandExpr(t->getLeft(), true, prelude, st);
+    Node *r = expandExpr(t->getRight(), true, prelude, st);
+    if (l == t->getLeft() && r == t->getRight()) return e;
+    return new Comparision(t->getOp(), l, r);
+  }
+  case _BOOLEAN: {
+    Boolean *t = static_cast<Boolean *>(e);
+    Node *l = expandExpr(t->getLeft(), true, prelude, st);
+    if (l == t->getLeft()) return e;
+    return new Boolean(t->getOp(), l, t->getRight());
+  }
+  case _FXN_CALL: {
+    FxnCall *call = static_cast<FxnCall *>(e);
+    FxnDef *callee = inlineTarget(call, need_value, st);
+    ParameterList *args = nodeCast<ParameterList *>(call->getNode());
+    if (args == NULL)
+      return e;
+    // arguments run first and in order, like they would for the call
+    vector<Node *> &arg_nodes = args->getParams();
+    vector<Node *> new_args;
+    bool changed = false;
+    for (size_t i=0; i<arg_nodes.size(); ++i) {
+      new_args.push_back(expandExpr(arg_nodes[i], true, prelude, st));
+      changed = changed || new_args[i] != arg_nodes[i];
+    }
+    if (callee != NULL)
+      return expandCall(callee, new_args, need_value, prelude, st);
+    if (!changed)
+      return e;
+    ParameterList *new_pl = new ParameterList();
+    for (size_t i=0; i<new_args.size(); ++i)
+      new_pl->addNode(new_args[i]);
+    return new FxnCall(call->getFxnSymbol(), new_pl);
+  }
+  default:
+    return e;
+  }
+}
+
+// expression e of a statement with its calls expanded into prelude, or e
+// itself if they can not be or the function grew too much already
+static Node *inlineExpr(Node *e, bool need_value, vector<Node *> &prelude,
+                        InlineState &st) {
+  int cost = hoistCost(e, true, need_value, st);
+  if (cost <= 0 || st.growth + cost > INLINE_GROWTH)
+    return e;
+  return expandExpr(e, need_value, prelude, st);
+}
+
+// s alone, or a block running prelude first
+static Node *withPrelude(vector<Node *> &prelude, Node *s) {
+  if (prelude.empty())
+    return s;
+  Block *block = new Block();
+  for (size_t i=0; i<prelude.size(); ++i)
+    block->addNode(prelude[i]);
+  if (s != NULL)
+    block->addNode(s);
+  return block;
+}
+
+// statement s with its calls expanded, what has to run before it goes to
+// prelude. NULL when nothing is left of s (an expanded call statement).
+static Node *inlineStatement(Node *s, vector<Node *> &prelude, InlineState &st) {
+  if (s == NULL) return nullptr;
+  switch (s->getKind()) {
+  case _BLOCK: {
+    Block *temp = static_cast<Block *>(s);
+    vector<Node *> &statements = temp->getStatements();
+    int size = statements.size();
+    vector<Node *> statement_seq;
+    bool changed = false;
+    for (int i=0; i<size; ++i) {
+      vector<Node *> before;
+      Node *statement = inlineStatement(statements[i], before, st);
+      if ((statement != statements[i] || !before.empty()) && !changed) {
+        changed = true;
+        statement_seq.assign(statements.begin(), statements.begin() + i);
+      }
+      if (changed) {
+        statement_seq.insert(statement_seq.end(), before.begin(), before.end());
+        if (statement != NULL)
+          statement_seq.push_back(statement);
+      }
+    }
+    if (!changed)
+      return s;
+    Block *new_block = new Block();
+    for (size_t i=0; i<statement_seq.size(); ++i)
+      new_block->addNode(statement_seq[i]);
+    return new_block;
+  }
+  case _ASSIGN: {
+    Assign *temp = static_cast<Assign *>(s);
+    Node *rhs = inlineExpr(temp->getRHS(), true, prelude, st);
+    if (rhs == temp->getRHS())
+      return s;
+    return new Assign(temp->getLHS(), rhs);
+  }
+  case _RETURN: {
+    Return *temp = static_cast<Return *>(s);
+    Node *ret_value = inlineExpr(temp->getNode(), true, prelude, st);
+    if (ret_value == temp->getNode())
+      return s;
+    return new Return(ret_value);
+  }
+  case _FXN_CALL:
+    // the value of a call statement is not used
+    return inlineExpr(s, false, prelude, st);
+  case _IF_THEN: {
+    IfThen *temp = static_cast<IfThen *>(s);
+    Node *cond = inlineExpr(temp->getCond(), true, prelude, st);
+    vector<Node *> body_prelude;
+    Node *body = inlineStatement(temp->getIfBody(), body_prelude, st);
+    body = withPrelude(body_prelude, body);
+    if (body == NULL)
+      body = new Block();
+    if (cond == temp->getCond() && body == temp->getIfBody())
+      return s;
+    return new IfThen(cond, body);
+  }
+  case _IF_THEN_ELSE: {
+    IfThenElse *temp = static_cast<IfThenElse *>(s);
+    Node *cond = inlineExpr(temp->getCond(), true, prelude, st);
+    vector<Node *> if_prelude, else_prelude;
+    Node *if_body = inlineStatement(temp->getIfBody(), if_prelude, st);
+    if_body = withPrelude(if_prelude, if_body);
+    Node *else_body = inlineStatement(temp->getElseBody(), else_prelude, st);
+    else_body = withPrelude(else_prelude, else_body);
+    if (if_body == NULL) if_body = new Block();
+    if (else_body == NULL) else_body = new Block();
+    if (cond == temp->getCond() && if_body == temp->getIfBody() &&
+        else_body == temp->getElseBody())
+      return s;
+    return new IfThenElse(cond, if_body, else_body);
+  }
+  case _WHILE: {
+    // the condition runs on every iteration, it keeps its calls
+    While *temp = static_cast<While *>(s);
+    vector<Node *> body_prelude;
+    Node *body = inlineStatement(temp->getBody(), body_prelude, st);
+    body = withPrelude(body_prelude, body);
+    if (body == NULL)
+      body = new Block();
+    if (body == temp->getBody())
+      return s;
+    return new While(temp->getCond(), body);
+  }
+  default:
+    return s;
+  }
+}
+
+// expand the calls in function name, after the calls in its callees
+static void inlineFunction(Symbol name, InlineState &st) {
+  st.visit[name] = 1;
+  int caller_growth = st.growth;
+  st.growth = 0;
+  FxnDef *def = st.defs[name];
+  vector<Node *> prelude;
+  Node *body = inlineStatement(def->getBody(), prelude, st);
+  if (body != def->getBody())
+    def = st.defs[name] = new FxnDef(def->getType(), def->getFxnNameArg(),
+                                     nodeCast<Block *>(body));
+  st.costs[name] = inlineCost(def);
+  st.visit[name] = 2;
+  st.growth = caller_growth;
+}
+
+Node *inlining(Node *root) {
+  Program *program = nodeCast<Program *>(root);
+  if (program == NULL)
+    return root;
+  InlineState st;
+  map<Symbol, FxnDef *> first;
+  vector<Node *> &nodes = program->getNodes();
+  int size = nodes.size();
+  for (int i=0; i<size; ++i)
+    if (FxnDef *def = nodeCast<FxnDef *>(nodes[i]))
+      if (first.insert(make_pair(def->getFxnSymbol(), def)).second)
+        st.defs[def->getFxnSymbol()] = def;
+  for (int i=0; i<size; ++i)
+    if (FxnDef *def = nodeCast<FxnDef *>(nodes[i]))
+      if (st.visit[def->getFxnSymbol()] == 0)
+        inlineFunction(def->getFxnSymbol(), st);
+
+  Program *new_program = NULL;
+  for (int i=0; i<size; ++i) {
+    Node *node = nodes[i];
+    FxnDef *def = nodeCast<FxnDef *>(node);
+    if (def != NULL && first[def->getFxnSymbol()] == def)
+      node = st.defs[def->getFxnSymbol()];
+    if (node != nodes[i] && new_program == NULL) {
+      new_program = new Program();
+      for (int j=0; j<i; ++j)
+        new_program->addNode(nodes[j]);
+    }
+    if (new_program != NULL)
+      new_program->addNode(node);
+  }
+  return new_program != NULL ? new_program : root;
 }
 } // namespace ast end
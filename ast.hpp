@@ -1,10 +1,16 @@
 #ifndef CC_AST_HPP
 #define CC_AST_HPP
 
+#include <cstdio>
 #include <iostream>
 #include <vector>
 #include <string>
+#include <type_traits>
+#include "llvm/ADT/StringRef.h"
+#include "symbol.hpp"
+#include "timing.hpp"
 using namespace std;
+using llvm::StringRef;
 namespace ast {
 
 class Node; // base class of all other classes
@@ -39,37 +45,134 @@ class FxnCall;
 
 class Temporary; // used for just temporary basis.
 
-// global var and fxns
-extern Program *prog;
+// global fxns
+// parse a whole translation unit in place, reentrant (see c.y).
+// base[size-2] and base[size-1] must be '\0'. Identifiers and strings point
+// into base, it has to outlive the returned tree. NULL if nothing parsed.
+Program *parseBuffer(char *base, size_t size, int *ret);
 void printAST(Node *);
-void dumpLLVMIr(Node *, string);
+
+// what dumpLLVMIr writes: textual IR, bitcode, host assembly or object
+enum EmitKind {_EMIT_LL, _EMIT_BC, _EMIT_ASM, _EMIT_OBJ};
+
+// how dumpLLVMIr generates and optimizes a module
+struct IrOptions {
+  IrOptions() : jobs(1), echo(false), opt_level(0), time_passes(false),
+                emit(_EMIT_LL) {}
+  string stage;     // names the phases of --time-report and --trace-json
+  int jobs;         // > 1 generates the functions of a Program on that many threads
+  bool echo;        // also print the module to stdout
+  int opt_level;    // 0..3, LLVM pipeline run before printing
+  string passes;    // comma separated pass names, replaces the -O pipeline
+  bool time_passes; // report the time of every pass on stderr
+  EmitKind emit;
+};
+// false (and a message) when the output file could not be written
+bool dumpLLVMIr(Node *, string, IrOptions &opts);
+// false if some name in the comma separated list is not a known pass
+bool checkPassList(string passes);
+// JIT the module of the last dumpLLVMIr call on this thread and call main,
+// false if that was not possible
+bool runLLVMIr(int *ret, double *seconds);
+// free the module of the last dumpLLVMIr call on this thread
+void releaseLLVMIr();
+// expand calls of small non-recursive functions in place, run before
+// precomputing (see ast.cpp). Returns root when nothing was inlined.
+Node *inlining(Node *);
 Node *precomputing(Node *);
 
+// bump pointer allocator owning every node of one compilation.
+// Nodes are carved out of large blocks and destroyed together in release().
+class Arena {
+ public:
+  Arena(size_t block_size = 64 * 1024)
+    :block_size(block_size), curr(NULL), end(NULL) {}
+  ~Arena() { release();}
+  void *allocate(size_t size, size_t align = alignof(std::max_align_t));
+  // owned copy of s that lives as long as the arena
+  StringRef copyString(StringRef s);
+  // remember n so that its destructor runs on release
+  void track(Node *n) { nodes.push_back(n);}
+  // destroy all tracked nodes and free every block in one step
+  void release();
+  size_t getNodeCount() { return nodes.size();}
+
+  // arena used by Node::operator new on this thread
+  static Arena *current();
+  static void setCurrent(Arena *a);
+ private:
+  Arena(const Arena &);
+  Arena &operator=(const Arena &);
+  size_t block_size;
+  char *curr;
+  char *end;
+  vector<char *> blocks;
+  vector<Node *> nodes;
+};
+
+// makes an arena current for the lifetime of the scope
+class ArenaScope {
+ public:
+  ArenaScope(Arena &a) : prev(Arena::current()) { Arena::setCurrent(&a);}
+  ~ArenaScope() { Arena::setCurrent(prev);}
+ private:
+  Arena *prev;
+};
+
+// one tag per concrete node class, lets passes dispatch with a switch
+enum NodeKind : unsigned char {
+  _INT_CONST, _STR_CONST, _PROGRAM, _BLOCK,
+  _ARITHMATIC, _BITWISE, _COMPARISION, _BOOLEAN, _ASSIGN, _RETURN,
+  _IDENTIFIER, _IDENTIFIER_LIST, _DECLARATION, _PARAMETER_LIST, _TYPE,
+  _IF_THEN, _IF_THEN_ELSE, _WHILE,
+  _FXN_NAME_ARG, _FXN_DEF, _F_DECLARATION, _FXN_CALL,
+  _TEMPORARY
+};
+
+// value of operator op of an _ARITHMATIC, _BITWISE, _COMPARISION or _BOOLEAN
+// node on two constants with 32-bit wraparound. False when the operation
+// traps or is undefined (x / 0, INT_MIN / -1, bad shift), it stays for runtime.
+bool foldConstant(NodeKind kind, int op, int left, int right, int *result);
+
 // This node must be the root of all nodes
 class Node {
  public:
-  Node() : debug_str("") {}
+  Node(NodeKind k) : kind(k) { Arena::current()->track(this);}
   virtual ~Node() {}
-  Node(const string str) : debug_str(str) {}
-  string getDebugStr() {return debug_str;}
-  void printString() { cout << debug_str; }
-  void appendCommaSepString(string s, bool first_time = true) {
-    if (!first_time)
-      debug_str = debug_str.substr(0, debug_str.size()-1) + ", " + s + ")";
-    else
-      debug_str = debug_str.substr(0, debug_str.size()-1) + s + ")";
-  }
-  void refresh(string s) {debug_str = s;}
+  NodeKind getKind() {return kind;}
+  // all nodes live in the current arena, memory is reclaimed by Arena::release
+  static void *operator new(size_t size) { return Arena::current()->allocate(size);}
+  static void operator delete(void *) {}
+  // stream the debug form of the subtree rooted here, nothing is cached
+  virtual void print(ostream &) {}
  private:
-  string debug_str;
+  NodeKind kind;
 };
 
+// drop-in for dynamic_cast<T *> that checks the kind tag instead of RTTI
+template <typename T>
+inline T nodeCast(Node *n) {
+  typedef typename remove_pointer<T>::type C;
+  return (n != NULL && C::classof(n)) ? static_cast<T>(n) : NULL;
+}
+
+// print a list of nodes separated by ", "
+inline void printNodeList(ostream &os, vector<Node *> &nodes) {
+  int size = nodes.size();
+  for (int i=0; i<size; ++i) {
+    if (i != 0) os << ", ";
+    nodes[i]->print(os);
+  }
+}
+
 // Integer constant
 class IntConst : public Node {
  public:
+   static bool classof(Node *n) { return n->getKind() == _INT_CONST;}
    IntConst(int v)
-     :Node("Integer_constant(" + to_string(v) + ")"), value(v) {}
+     :Node(_INT_CONST), value(v) {}
    int getVal() {return value;}
+   void print(ostream &os) { os << "Integer_constant(" << value << ")";}
    Node * getCopy() { return new IntConst(value);}
  private:
   int value;
@@ -78,26 +181,40 @@ class IntConst : public Node {
 // string const
 class StrConst : public Node {
  public:
-  StrConst(string s)
-    :Node("StrConst("+ s+")"), str(s) {}
+  static bool classof(Node *n) { return n->getKind() == _STR_CONST;}
+  // copy = false keeps a view, the text must outlive the tree
+  StrConst(StringRef s, bool copy = true)
+    :Node(_STR_CONST), str(copy ? Arena::current()->copyString(s) : s) {}
   string getString() {
-    return str;
+    return str.str();
   }
-  Node *getCopy() { return new StrConst(str);}
+  Node *getCopy() { return new StrConst(str, false);}
+  void print(ostream &os) { os << "StrConst(" << str.str() << ")";}
  private:
-  string str;
+  StringRef str;
 };
 
 /*program is list of nodes*/
 class Program : public Node {
  public:
-  Program() : Node("program()") {}
-  Program(Node *n) : Node("Program()") { this->addNode(n);}
+  static bool classof(Node *n) { return n->getKind() == _PROGRAM;}
+  Program() : Node(_PROGRAM) {}
+  Program(Node *n) : Node(_PROGRAM) { this->addNode(n);}
   void addNode(Node *n) {
-    this->appendCommaSepString("\t" + n->getDebugStr() + "\n\n", (node_array.size() == 0));
     node_array.push_back(n); // !! order matters !!
   }
-  vector<Node *> getNodes() { return node_array;}
+  vector<Node *> &getNodes() { return node_array;}
+  void print(ostream &os) {
+    os << "program(";
+    int size = node_array.size();
+    for (int i=0; i<size; ++i) {
+      if (i != 0) os << ", ";
+      os << "\t";
+      node_array[i]->print(os);
+      os << "\n\n";
+    }
+    os << ")";
+  }
  private:
   vector<Node *> node_array;
 };
@@ -106,13 +223,17 @@ class Program : public Node {
 enum AriOp{_ADD, _SUB, _MUL, _DIV, _MOD};
 class Arithmatic : public Node {
  public:
+  static bool classof(Node *n) { return n->getKind() == _ARITHMATIC;}
   Arithmatic(AriOp op, Node *l_oprand, Node *r_oprand)
-    :Node("Arithmatic()"), op(op), l_oprand(l_oprand), r_oprand(r_oprand) {
-      string str = l_oprand->getDebugStr() + ", " + 
-                   this->opToString(op) + ", " + r_oprand->getDebugStr();
-      this->appendCommaSepString(str);
-    }
-  string opToString(AriOp o) {
+    :Node(_ARITHMATIC), op(op), l_oprand(l_oprand), r_oprand(r_oprand) {}
+  void print(ostream &os) {
+    os << "Arithmatic(";
+    l_oprand->print(os);
+    os << ", " << opToString(op) << ", ";
+    r_oprand->print(os);
+    os << ")";
+  }
+  static string opToString(AriOp o) {
     switch (o) {
       case _ADD:  return "+";
       case _SUB:  return "-";
@@ -135,16 +256,20 @@ class Arithmatic : public Node {
 enum BitOp{_AND, _OR, _LSHIFT, _RSHIFT, _XOR};
 class Bitwise : public Node {
  public:
+   static bool classof(Node *n) { return n->getKind() == _BITWISE;}
    Bitwise(BitOp o, Node *l, Node *r)
-     :Node("Bitwise()"), op(o), l_oprand(l), r_oprand(r) {
-       string str = l->getDebugStr() + ", " + this->opToString(o) + ", "+
-                    r->getDebugStr();
-       this->appendCommaSepString(str);
-     }
+     :Node(_BITWISE), op(o), l_oprand(l), r_oprand(r) {}
+   void print(ostream &os) {
+     os << "Bitwise(";
+     l_oprand->print(os);
+     os << ", " << opToString(op) << ", ";
+     r_oprand->print(os);
+     os << ")";
+   }
    Node *getLeft() { return l_oprand;}
    Node *getRight() { return r_oprand;}
    BitOp getOp() { return op;}
-   string opToString(BitOp o) {
+   static string opToString(BitOp o) {
      switch (o) {
        case _AND:     return "&";
        case _OR:      return "|";
@@ -164,12 +289,17 @@ class Bitwise : public Node {
 enum CompOp{_LT, _GT, _GEQ, _LEQ, _EQEQ, _NEQ};
 class Comparision : public Node {
  public:
+  static bool classof(Node *n) { return n->getKind() == _COMPARISION;}
   Comparision(CompOp o, Node *l, Node *r)
-    :Node("Comparision()"), op(o), l_oprand(l), r_oprand(r) {
-      string str = l->getDebugStr() + ", " + this->opToString(o) + ", " + r->getDebugStr();
-      this->appendCommaSepString(str);
-    }
-  string opToString(CompOp o) {
+    :Node(_COMPARISION), op(o), l_oprand(l), r_oprand(r) {}
+  void print(ostream &os) {
+    os << "Comparision(";
+    l_oprand->print(os);
+    os << ", " << opToString(op) << ", ";
+    r_oprand->print(os);
+    os << ")";
+  }
+  static string opToString(CompOp o) {
     switch (o) {
       case _LT:     return "<";
       case _GT:     return ">";
@@ -193,12 +323,17 @@ class Comparision : public Node {
 enum BoolOp{_ANDAND, _OROR};
 class Boolean : public Node {
  public:
+  static bool classof(Node *n) { return n->getKind() == _BOOLEAN;}
   Boolean(BoolOp o, Node *l, Node *r)
-    :Node("Boolean()"), op(o), l_oprand(l), r_oprand(r) {
-      string str = l->getDebugStr() + ", " + this->opToString(o) + ", " + r->getDebugStr();
-      this->appendCommaSepString(str);
-    }
-  string opToString(BoolOp o) {
+    :Node(_BOOLEAN), op(o), l_oprand(l), r_oprand(r) {}
+  void print(ostream &os) {
+    os << "Boolean(";
+    l_oprand->print(os);
+    os << ", " << opToString(op) << ", ";
+    r_oprand->print(os);
+    os << ")";
+  }
+  static string opToString(BoolOp o) {
     switch (o) {
       case _ANDAND:   return "&&";
       case _OROR:     return "||";
@@ -217,10 +352,16 @@ class Boolean : public Node {
 // lhs = rhs
 class Assign : public Node {
  public:
+  static bool classof(Node *n) { return n->getKind() == _ASSIGN;}
   Assign(Node *l, Node *r)
-    :Node("Assign()"), lhs(l), rhs(r) {
-      this->appendCommaSepString(l->getDebugStr() + " = " + r->getDebugStr());
-    }
+    :Node(_ASSIGN), lhs(l), rhs(r) {}
+  void print(ostream &os) {
+    os << "Assign(";
+    lhs->print(os);
+    os << " = ";
+    rhs->print(os);
+    os << ")";
+  }
   Node *getLHS() { return lhs;}
   Node *getRHS() { return rhs;}
  private:
@@ -231,15 +372,18 @@ class Assign : public Node {
 // { ... }
 class Block : public Node{
  public:
-  Block()
-    :Node("Block()") {}
-  Block(Node *p)
-    :Node("Block()") {this->addNode(p);}
+  static bool classof(Node *n) { return n->getKind() == _BLOCK;}
+  Block() : Node(_BLOCK) {}
+  Block(Node *p) : Node(_BLOCK) {this->addNode(p);}
   void addNode(Node *b) {
-    this->appendCommaSepString(b->getDebugStr(), (statement_seq.size() == 0));
     statement_seq.push_back(b); // !! order matters !!
   }
-  vector<Node *> getStatements() { return statement_seq;}
+  vector<Node *> &getStatements() { return statement_seq;}
+  void print(ostream &os) {
+    os << "Block(";
+    printNodeList(os, statement_seq);
+    os << ")";
+  }
  private:
   vector<Node *> statement_seq;
 };
@@ -247,67 +391,99 @@ class Block : public Node{
 // function name, variable name
 class Identifier : public Node{
  public:
-  Identifier(string str)
-    :Node("Identifier(" + str + ")"), name(str) {}
+  static bool classof(Node *n) { return n->getKind() == _IDENTIFIER;}
+  Identifier(Symbol s)
+    :Node(_IDENTIFIER), name(s) {}
+  string getName() {return Interner::current()->str(name).str();}
+  Symbol getSymbol() {return name;}
   Node *getCopy() {return new Identifier(name);}
+  void print(ostream &os) { os << "Identifier(" << Interner::current()->str(name).str() << ")";}
  private:
-  string name;
+  Symbol name;
 };
 
 // function arguments
 class IdentifierList : public Node{
  public:
+  static bool classof(Node *n) { return n->getKind() == _IDENTIFIER_LIST;}
   IdentifierList()
-   :Node("IdentifierList()"), pointer_count(0) {}
-  IdentifierList(string s)
-   :Node("IdentifierList()"), pointer_count(0) { this->addString(s);}
-
-  void addString(string s) {
-    this->appendCommaSepString(s, (identifier_list.size() == 0));
+   :Node(_IDENTIFIER_LIST), pointer_count(0) {}
+  // interned in the current interner, copy = false keeps a view into s
+  IdentifierList(StringRef s, bool copy = true)
+   :Node(_IDENTIFIER_LIST), pointer_count(0) { this->addString(s, copy);}
+  IdentifierList(Symbol s)
+   :Node(_IDENTIFIER_LIST), pointer_count(0) { this->addSymbol(s);}
+
+  void addString(StringRef s, bool copy = true) {
+    addSymbol(Interner::current()->intern(s, copy));
+  }
+  void addSymbol(Symbol s) {
     identifier_list.push_back(s); // !! order matters
   }
   
   void addPointerCount(int pcount) {
       pointer_count = pcount;
       if (identifier_list.size() != 1)
-        cout << "ASSUMPTION FAILED: identifier list with size != 1\n";
-      string stars = "";
-      for (int i=0; i<pcount; ++i) stars += "*";
-      string id1 = identifier_list[0];
-      this->refresh("IdentifierList(" + stars + id1 + ")");
+        cerr << "ASSUMPTION FAILED: identifier list with size != 1\n";
     }
 
-  string getString() {
+  void print(ostream &os) {
+    Interner *names = Interner::current();
+    os << "IdentifierList(";
+    if (pointer_count > 0) {
+      for (int i=0; i<pointer_count; ++i) os << "*";
+      os << names->str(identifier_list[0]).str();
+    }
+    else {
+      int size = identifier_list.size();
+      for (int i=0; i<size; ++i)
+        os << (i == 0 ? "" : ", ") << names->str(identifier_list[i]).str();
+    }
+    os << ")";
+  }
+
+  Symbol getSymbol() {
     if (identifier_list.size() != 1)
-      cout << "ASSUMPTION FAILED: identifier list with size != 1\n";
+      cerr << "ASSUMPTION FAILED: identifier list with size != 1\n";
     return identifier_list[0];
   }
 
+  string getString() {
+    return Interner::current()->str(getSymbol()).str();
+  }
+
   // If this class is used to store function name then return it
   string getFxnName() {
     if (identifier_list.size() == 1)
-      return identifier_list[0];
-    cout << "ERROR: getFxnName called for non function type\n";
+      return Interner::current()->str(identifier_list[0]).str();
+    cerr << "ERROR: getFxnName called for non function type\n";
     return "Not Possible";
   }
 
   // return list of identifiers
   vector<string> getAllIdentifiers() {
-    return identifier_list;
+    vector<string> ids;
+    int size = identifier_list.size();
+    for (int i=0; i<size; ++i)
+      ids.push_back(Interner::current()->str(identifier_list[i]).str());
+    return ids;
   }
+  vector<Symbol> &getSymbols() {return identifier_list;}
+
+  int getPointerCount() {return pointer_count;}
 
   Node *getCopy() {
     IdentifierList *il = new IdentifierList();
     if (identifier_list.size() != 1) {
-      cout << "ASSUMPTION FAILED: identifier_list.size() != 1\n";
+      cerr << "ASSUMPTION FAILED: identifier_list.size() != 1\n";
       return nullptr;
     }
-    il->addString(identifier_list[0]);
+    il->addSymbol(identifier_list[0]);
     il->addPointerCount(pointer_count);
     return il;
   }
  private:
-  vector<string> identifier_list;
+  vector<Symbol> identifier_list;
   int pointer_count;
 };
 
@@ -316,19 +492,24 @@ enum Tp {_VOID, _INT, _CHAR};
 enum Attr {_CONST, _NONE};
 class Type : public Node {
  public:
+  static bool classof(Node *n) { return n->getKind() == _TYPE;}
   Type(Tp t)
-    :Node("Type()"), type(t), attr(_NONE) {
-      this->appendCommaSepString(opToString(t));
-    }
+    :Node(_TYPE), type(t), attr(_NONE) {}
   
   void addAttr(Attr a) {
     switch (a) {
-      case _CONST:  { this->appendCommaSepString("const", false); break;}
+      case _CONST:  { attr = a; break;}
       case _NONE:   { break;}
     }
   }
+
+  void print(ostream &os) {
+    os << "Type(" << opToString(type);
+    if (attr == _CONST) os << ", const";
+    os << ")";
+  }
  
-  string opToString(Tp t) {
+  static string opToString(Tp t) {
     switch (t) {
       case _VOID:       return "void";
       case _INT:        return "int";
@@ -338,6 +519,7 @@ class Type : public Node {
   }
 
   Tp getType() {return type;}
+  Attr getAttr() {return attr;}
 
   Node *getCopy() { 
     Type *temp = new Type(type); 
@@ -352,20 +534,30 @@ class Type : public Node {
 // int a, b
 class Declaration : public Node {
  public:
+  static bool classof(Node *n) { return n->getKind() == _DECLARATION;}
   Declaration(Type *t, IdentifierList *il)
-    :Node("Declaration()"), type(t), id_list(il){
-      this->appendCommaSepString(t->getDebugStr() + ", " + il->getDebugStr());
-    }
+    :Node(_DECLARATION), type(t), id_list(il) {}
+  void print(ostream &os) {
+    os << "Declaration(";
+    type->print(os);
+    os << ", ";
+    id_list->print(os);
+    os << ")";
+  }
 
   // return type
   Tp getType() {return type->getType();}
 
   // return name
   string getName() {return id_list->getFxnName();}
+  Symbol getSymbol() {return id_list->getSymbol();}
+
+  Type *getTypeNode() {return type;}
+  IdentifierList *getIdList() {return id_list;}
 
   Node *getCopy() {
-    Type *new_type = dynamic_cast<Type *>(type->getCopy());
-    IdentifierList *new_il = dynamic_cast<IdentifierList *>(id_list->getCopy());
+    Type *new_type = nodeCast<Type *>(type->getCopy());
+    IdentifierList *new_il = nodeCast<IdentifierList *>(id_list->getCopy());
     return new Declaration(new_type, new_il);
   }
  private:
@@ -376,19 +568,24 @@ class Declaration : public Node {
 // function arguments
 class ParameterList : public Node {
  public:
-  ParameterList() : Node("ParameterList()") {}
-  ParameterList(Node *n) : Node("ParameterList()") {this->addNode(n);}
+  static bool classof(Node *n) { return n->getKind() == _PARAMETER_LIST;}
+  ParameterList() : Node(_PARAMETER_LIST) {}
+  ParameterList(Node *n) : Node(_PARAMETER_LIST) {this->addNode(n);}
   void addNode(Node *n) {
-    this->appendCommaSepString(n->getDebugStr(), (params.size() == 0));
     params.push_back(n); // !! order matters !!
   }
+  void print(ostream &os) {
+    os << "ParameterList(";
+    printNodeList(os, params);
+    os << ")";
+  }
 
   // return vector<Tp> types of args
   vector<Tp> getArgTypes() {
     int size = params.size();
     vector<Tp> types;
     for (int i=0; i<size; ++i) {
-      Declaration *temp_d = dynamic_cast<Declaration *>(params[i]);
+      Declaration *temp_d = nodeCast<Declaration *>(params[i]);
       types.push_back(temp_d->getType());
     }
     return types;
@@ -399,13 +596,21 @@ class ParameterList : public Node {
     int size = params.size();
     vector<string> names;
     for (int i=0; i<size; ++i) {
-      Declaration *temp_d = dynamic_cast<Declaration *>(params[i]);
+      Declaration *temp_d = nodeCast<Declaration *>(params[i]);
       names.push_back(temp_d->getName());
     }
     return names;
   }
 
-  vector<Node *> getParams() {return params;}
+  vector<Symbol> getArgSymbols() {
+    int size = params.size();
+    vector<Symbol> names;
+    for (int i=0; i<size; ++i)
+      names.push_back(nodeCast<Declaration *>(params[i])->getSymbol());
+    return names;
+  }
+
+  vector<Node *> &getParams() {return params;}
  private:
   vector<Node *> params;
 };
@@ -413,24 +618,30 @@ class ParameterList : public Node {
 // function name and list of args
 class FxnNameArg : public Node{
  public:
-   FxnNameArg(string n, ParameterList * il)
-     :Node("fxnNameArg()"), fxn_name(n), arg_list(il) {
-       this->appendCommaSepString(n +", "+ il->getDebugStr());
-     }
+   static bool classof(Node *n) { return n->getKind() == _FXN_NAME_ARG;}
+   FxnNameArg(Symbol n, ParameterList * il)
+     :Node(_FXN_NAME_ARG), fxn_name(n), arg_list(il) {}
+   void print(ostream &os) {
+     os << "fxnNameArg(" << getFxnName() << ", ";
+     arg_list->print(os);
+     os << ")";
+   }
 
    // return name of the function
-   string getFxnName() { return fxn_name;}
+   string getFxnName() { return Interner::current()->str(fxn_name).str();}
+   Symbol getFxnSymbol() { return fxn_name;}
 
    // return vector<Tp> arg types
    vector<Tp> getArgTypes() { return arg_list->getArgTypes();}
 
    // arg names
    vector<string> getArgNames() {return arg_list->getArgNames();}
+   vector<Symbol> getArgSymbols() {return arg_list->getArgSymbols();}
 
    Node *getArgList() { return arg_list;}
 
  private:
-  string fxn_name;
+  Symbol fxn_name;
   ParameterList *arg_list;
 };
 
@@ -438,20 +649,29 @@ class FxnNameArg : public Node{
 // return type, fxn name, args, body
 class FxnDef : public Node{
  public:
+  static bool classof(Node *n) { return n->getKind() == _FXN_DEF;}
   FxnDef(Type *t, FxnNameArg *n, Block *b)
-    :Node("FxnDef()"), ret_type(t), name_arg(n), body(b) {
-      string str = t->getDebugStr() + ", " + n->getDebugStr() + ", " + b->getDebugStr();
-      this->appendCommaSepString(str);
-    }
+    :Node(_FXN_DEF), ret_type(t), name_arg(n), body(b) {}
+  void print(ostream &os) {
+    os << "FxnDef(";
+    ret_type->print(os);
+    os << ", ";
+    name_arg->print(os);
+    os << ", ";
+    body->print(os);
+    os << ")";
+  }
 
   // return name of the function
   string getFxnName() { return (name_arg->getFxnName()); }
+  Symbol getFxnSymbol() { return (name_arg->getFxnSymbol()); }
 
   // return vector<Tp> arg types
   vector<Tp> getArgTypes() { return name_arg->getArgTypes(); }
 
   // return vector<string> var names
   vector<string> getArgNames() {return name_arg->getArgNames();}
+  vector<Symbol> getArgSymbols() {return name_arg->getArgSymbols();}
 
   // return type
   Tp getRetType() {return ret_type->getType();}
@@ -469,24 +689,32 @@ class FxnDef : public Node{
 // return type, FxnNameArg
 class FDeclaration : public Node {
  public:
+  static bool classof(Node *n) { return n->getKind() == _F_DECLARATION;}
   FDeclaration(Node *ret_t, Node *fxn_n_a)
-    :Node("FDeclaration()"), ret_type(ret_t), fxn_name_arg(fxn_n_a) {
-      string str = ret_t->getDebugStr() + ", " + fxn_n_a->getDebugStr();
-      this->appendCommaSepString(str);
-    }
+    :Node(_F_DECLARATION), ret_type(ret_t), fxn_name_arg(fxn_n_a) {}
+  void print(ostream &os) {
+    os << "FDeclaration(";
+    ret_type->print(os);
+    os << ", ";
+    fxn_name_arg->print(os);
+    os << ")";
+  }
   Tp getType() {
-    return dynamic_cast<Type *>(ret_type)->getType();
+    return nodeCast<Type *>(ret_type)->getType();
   }
   string getVarName() {
-    IdentifierList *var = dynamic_cast<IdentifierList*>(fxn_name_arg);
+    IdentifierList *var = nodeCast<IdentifierList*>(fxn_name_arg);
     if (var != NULL) {
       return var->getString();
     }
     else {
-      cout << "Assumption failed: fxn_name_arg not dynamically castable to identifier list";
+      cerr << "Assumption failed: fxn_name_arg not dynamically castable to identifier list";
       return "";
     }
   }
+  Symbol getVarSymbol() {
+    return nodeCast<IdentifierList *>(fxn_name_arg)->getSymbol();
+  }
   Node *getRetType() { return ret_type;}
   Node *getNameArg() { return fxn_name_arg;}
  private:
@@ -496,26 +724,36 @@ class FDeclaration : public Node {
 
 class FxnCall : public Node {
  public:
-  FxnCall(string name, Node *vs)
-    :Node("FxnCall()"), fxn_name(name), values(vs) {
-      this->appendCommaSepString(name + ", " + vs->getDebugStr());
-    }
-  string getFxnName() {return fxn_name;}
+  static bool classof(Node *n) { return n->getKind() == _FXN_CALL;}
+  FxnCall(Symbol name, Node *vs)
+    :Node(_FXN_CALL), fxn_name(name), values(vs) {}
+  void print(ostream &os) {
+    os << "FxnCall(" << getFxnName() << ", ";
+    values->print(os);
+    os << ")";
+  }
+  string getFxnName() {return Interner::current()->str(fxn_name).str();}
+  Symbol getFxnSymbol() {return fxn_name;}
   Node *getNode() {return values;}
  private:
-  string fxn_name;
+  Symbol fxn_name;
   Node *values;
 };
 
 // return expr;, return;
 class Return : public Node{
  public:
+  static bool classof(Node *n) { return n->getKind() == _RETURN;}
   Return() // call if return;
-    :Node("Return(NULL)"), ret_value(NULL) {}
+    :Node(_RETURN), ret_value(NULL) {}
   Return(Node *n) // call if return expr;
-    :Node("Return()"), ret_value(n) {
-      this->appendCommaSepString(n->getDebugStr());
-    }
+    :Node(_RETURN), ret_value(n) {}
+  void print(ostream &os) {
+    if (ret_value == NULL) { os << "Return(NULL)"; return;}
+    os << "Return(";
+    ret_value->print(os);
+    os << ")";
+  }
   Node *getNode() { return ret_value;}
  private:
   Node *ret_value;
@@ -525,8 +763,9 @@ class Return : public Node{
 // {0:const}
 class Temporary : public Node {
  public:
+  static bool classof(Node *n) { return n->getKind() == _TEMPORARY;}
   Temporary(int t)
-    :temp(t) {}
+    :Node(_TEMPORARY), temp(t) {}
   int getTemp() {return temp;}
   void add(int a) {temp += a;}
  private:
@@ -536,10 +775,16 @@ class Temporary : public Node {
 // if () {}
 class IfThen : public Node {
  public:
+  static bool classof(Node *n) { return n->getKind() == _IF_THEN;}
   IfThen(Node *c, Node *b)
-    :Node("IfThen()"), cond(c), if_body(b) {
-      this->appendCommaSepString(c->getDebugStr() + ", " + b->getDebugStr());
-    }
+    :Node(_IF_THEN), cond(c), if_body(b) {}
+  void print(ostream &os) {
+    os << "IfThen(";
+    cond->print(os);
+    os << ", ";
+    if_body->print(os);
+    os << ")";
+  }
   Node *getCond() { return cond;}
   Node *getIfBody() { return if_body;}
  private:
@@ -550,11 +795,18 @@ class IfThen : public Node {
 // if () {} else {}
 class IfThenElse : public Node {
  public:
+  static bool classof(Node *n) { return n->getKind() == _IF_THEN_ELSE;}
   IfThenElse(Node *c, Node *ib, Node *eb)
-    :Node("IfThenElse()"), cond(c), if_body(ib), else_body(eb) {
-      this->appendCommaSepString(c->getDebugStr() + ", " + ib->getDebugStr() + 
-                                 ", " + eb->getDebugStr());
-    }
+    :Node(_IF_THEN_ELSE), cond(c), if_body(ib), else_body(eb) {}
+  void print(ostream &os) {
+    os << "IfThenElse(";
+    cond->print(os);
+    os << ", ";
+    if_body->print(os);
+    os << ", ";
+    else_body->print(os);
+    os << ")";
+  }
   Node *getCond() {return cond;}
   Node *getIfBody() {return if_body;}
   Node *getElseBody() {return else_body;}
@@ -567,10 +819,16 @@ class IfThenElse : public Node {
 // while() {}
 class While : public Node {
  public:
+  static bool classof(Node *n) { return n->getKind() == _WHILE;}
   While(Node *c, Node *b)
-    :Node("While()"), cond(c), body(b) {
-      this->appendCommaSepString(c->getDebugStr() + ", " + b->getDebugStr());
-    }
+    :Node(_WHILE), cond(c), body(b) {}
+  void print(ostream &os) {
+    os << "While(";
+    cond->print(os);
+    os << ", ";
+    body->print(os);
+    os << ")";
+  }
   Node *getCond() {return cond;}
   Node *getBody() {return body;}
  private:
@@ -0,0 +1,133 @@
+#!/usr/bin/env python3
+"""Compile-time benchmark: time every phase of cc on generated programs.
+
+Each sweep grows one dimension of the generated input (number of functions,
+expression depth, block length, nesting) and keeps the others at their
+defaults. For every size the program is compiled --reps times with
+--time-report, the fastest run of each phase is kept.
+
+Results go to <out>/compile.csv and <out>/compile.json, one row per size and
+phase, plus a "total" row with lines/sec and nodes/sec. Plot wall_ms against
+lines per phase to see how a phase scales, a quadratic one bends upwards.
+"""
+
+import argparse
+import csv
+import json
+import os
+import re
+import subprocess
+import sys
+import tempfile
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+
+# name: (argument of gen.py, sizes, other gen.py arguments). Blocks nest, a
+# function has about stmts^(nest+1) statements, so long blocks are kept flat.
+SWEEPS = {
+    "functions": ("--functions", [10, 20, 40, 80, 160, 320], []),
+    "depth": ("--depth", [2, 3, 4, 5, 6, 7, 8], []),
+    "stmts": ("--stmts", [50, 100, 200, 400, 800, 1600, 3200], ["--nest", "0"]),
+    "nest": ("--nest", [1, 2, 3, 4, 5], []),
+}
+
+ROW = re.compile(r"^  (.+?)\s+(-?[\d.]+)\s+(-?[\d.]+)\s+(\d+)\s+(\d+)\s+([\d.]+)$")
+NODES = re.compile(r"^  AST nodes: (\d+)$")
+
+
+def parse_report(text):
+    """phase rows and node count of one --time-report table"""
+    phases, nodes = {}, 0
+    for line in text.splitlines():
+        m = NODES.match(line)
+        if m:
+            nodes = int(m.group(1))
+            continue
+        m = ROW.match(line)
+        if m and m.group(1) != "phase":
+            # "lex (1234 tokens)" -> "lex"
+            name = re.sub(r" \(\d+ tokens\)$", "", m.group(1))
+            phases[name] = {
+                "wall_ms": float(m.group(2)),
+                "cpu_ms": float(m.group(3)),
+                "peak_rss_kb": int(m.group(4)),
+                "allocs": int(m.group(5)),
+                "alloc_kb": float(m.group(6)),
+            }
+    return phases, nodes
+
+
+def compile_once(cc, flags, source, workdir):
+    cmd = [cc, "--time-report", "-o", os.path.join(workdir, "out.ll")] + flags + [source]
+    proc = subprocess.run(cmd, stdout=subprocess.PIPE, stderr=subprocess.PIPE,
+                          universal_newlines=True)
+    if proc.returncode != 0:
+        sys.exit("compile_bench: %s failed:\n%s" % (" ".join(cmd), proc.stderr))
+    return parse_report(proc.stderr)
+
+
+def measure(cc, flags, source, reps, workdir):
+    """fastest of reps runs, phase by phase"""
+    best, nodes = {}, 0
+    for _ in range(reps):
+        phases, nodes = compile_once(cc, flags, source, workdir)
+        for name, row in phases.items():
+            if name not in best or row["wall_ms"] < best[name]["wall_ms"]:
+                best[name] = row
+    return best, nodes
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--cc", default=os.path.join(HERE, "..", "cc"))
+    parser.add_argument("--out", default=os.path.join(HERE, "results"))
+    parser.add_argument("--sweep", action="append", choices=sorted(SWEEPS),
+                        help="run only these sweeps (repeatable), default all")
+    parser.add_argument("--reps", type=int, default=3)
+    parser.add_argument("--flags", default="",
+                        help="extra cc flags, e.g. \"-O2 --unoptimized\"")
+    parser.add_argument("--seed", type=int, default=1)
+    parser.add_argument("--quick", action="store_true",
+                        help="only the three smallest sizes of every sweep")
+    args = parser.parse_args()
+
+    os.makedirs(args.out, exist_ok=True)
+    flags = args.flags.split()
+    rows = []
+    with tempfile.TemporaryDirectory() as workdir:
+        for sweep in args.sweep or sorted(SWEEPS):
+            option, sizes, others = SWEEPS[sweep]
+            for size in sizes[:3] if args.quick else sizes:
+                source = os.path.join(workdir, "%s_%d.c" % (sweep, size))
+                subprocess.run([sys.executable, os.path.join(HERE, "gen.py"),
+                                option, str(size), "--seed", str(args.seed),
+                                "-o", source] + others, check=True)
+                with open(source) as f:
+                    lines = sum(1 for _ in f)
+                phases, nodes = measure(args.cc, flags, source, args.reps, workdir)
+                for name, row in phases.items():
+                    entry = {"sweep": sweep, "size": size, "lines": lines,
+                             "nodes": nodes, "phase": name}
+                    entry.update(row)
+                    if name == "total" and row["wall_ms"] > 0:
+                        entry["lines_per_sec"] = round(lines / row["wall_ms"] * 1e3)
+                        entry["nodes_per_sec"] = round(nodes / row["wall_ms"] * 1e3)
+                    rows.append(entry)
+                total = phases.get("total", {}).get("wall_ms", 0)
+                print("%-10s %5d  %7d lines %8d nodes  %10.3f ms" %
+                      (sweep, size, lines, nodes, total))
+
+    fields = ["sweep", "size", "lines", "nodes", "phase", "wall_ms", "cpu_ms",
+              "peak_rss_kb", "allocs", "alloc_kb", "lines_per_sec", "nodes_per_sec"]
+    with open(os.path.join(args.out, "compile.csv"), "w") as f:
+        writer = csv.DictWriter(f, fieldnames=fields)
+        writer.writeheader()
+        writer.writerows(rows)
+    with open(os.path.join(args.out, "compile.json"), "w") as f:
+        json.dump({"cc": args.cc, "flags": args.flags, "seed": args.seed,
+                   "reps": args.reps, "rows": rows}, f, indent=1)
+    print("results in %s/compile.{csv,json}" % args.out)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,146 @@
+#!/usr/bin/env python3
+"""Generate a C program in the subset cc understands, of tunable size.
+
+  gen.py --functions 100 --depth 6 --stmts 20 --nest 3 > big.c
+
+Every function takes int parameters, declares its locals up front and
+returns an int. Function i only calls functions before it, so there is no
+recursion and main can run the whole program. Loops count up to a small
+bound, divisions and shifts use constants, so the program terminates and
+never traps whatever the seed.
+"""
+
+import argparse
+import random
+import sys
+
+
+class Generator:
+    def __init__(self, args):
+        self.args = args
+        self.rnd = random.Random(args.seed)
+        self.out = []
+        self.loop_count = 0
+        self.arities = []  # parameters of every function generated so far
+
+    def emit(self, indent, text):
+        self.out.append("  " * indent + text)
+
+    def leaf(self, names):
+        if self.rnd.random() < 0.3:
+            return str(self.rnd.randint(0, 99))
+        return self.rnd.choice(names)
+
+    def call(self, names, depth):
+        callee = self.rnd.randrange(len(self.arities))
+        args = [self.expr(names, depth) for _ in range(self.arities[callee])]
+        return "f%d(%s)" % (callee, ", ".join(args))
+
+    def expr(self, names, depth):
+        """a full binary tree of the given depth, calls sit at the leaves"""
+        if depth <= 0:
+            if self.arities and self.rnd.random() < self.args.calls:
+                return self.call(names, 0)
+            return self.leaf(names)
+        op = self.rnd.choice(["+", "-", "*", "&", "|", "^", "/", "%", "<<", ">>"])
+        left = self.expr(names, depth - 1)
+        if op in ("/", "%"):
+            right = str(self.rnd.randint(2, 9))
+        elif op in ("<<", ">>"):
+            right = str(self.rnd.randint(1, 3))
+        else:
+            right = self.expr(names, depth - 1)
+        return "(%s %s %s)" % (left, op, right)
+
+    def cond(self, names):
+        op = self.rnd.choice(["<", ">", "<=", ">=", "==", "!="])
+        depth = max(0, self.args.depth // 2)
+        return "%s %s %s" % (self.expr(names, depth), op, self.expr(names, depth))
+
+    def block(self, indent, names, targets, nest):
+        for _ in range(self.args.stmts):
+            kind = self.rnd.random()
+            if nest > 0 and kind < 0.15:
+                # counter and bound are fresh, the body never writes them
+                counter = "c%d" % self.loop_count
+                self.loop_count += 1
+                names.append(counter)
+                self.emit(indent, "%s = 0;" % counter)
+                self.emit(indent, "while (%s < %d) {" % (counter, self.args.trips))
+                self.block(indent + 1, names, targets, nest - 1)
+                self.emit(indent + 1, "%s = %s + 1;" % (counter, counter))
+                self.emit(indent, "}")
+            elif nest > 0 and kind < 0.3:
+                self.emit(indent, "if (%s) {" % self.cond(names))
+                self.block(indent + 1, names, targets, nest - 1)
+                self.emit(indent, "}")
+            else:
+                target = self.rnd.choice(targets)
+                self.emit(indent, "%s = %s;" % (target, self.expr(names, self.args.depth)))
+
+    def function(self, name, params):
+        locals_ = ["v%d" % i for i in range(self.args.locals)]
+        self.emit(0, "int %s(%s)" % (name, ", ".join("int " + p for p in params)))
+        self.emit(0, "{")
+        body_start = len(self.out)
+        for v in locals_:
+            self.emit(1, "int %s;" % v)
+        for v in locals_:
+            self.emit(1, "%s = %s;" % (v, self.leaf(params or ["1"])))
+        names = params + locals_
+        self.loop_count = 0
+        self.block(1, names, locals_, self.args.nest)
+        # loop counters are locals too, declared and zeroed with the others,
+        # a counter of a loop that did not run may still be read later
+        counters = ["int c%d;" % i for i in range(self.loop_count)]
+        counters += ["c%d = 0;" % i for i in range(self.loop_count)]
+        self.out[body_start:body_start] = ["  " + c for c in counters]
+        self.emit(1, "return %s;" % " + ".join(locals_))
+        self.emit(0, "}")
+        self.emit(0, "")
+
+    def program(self):
+        for i in range(self.args.functions):
+            params = ["p%d" % j for j in range(self.rnd.randint(1, 3))]
+            self.function("f%d" % i, params)
+            self.arities.append(len(params))
+        # main calls the last functions, which reach the others
+        calls = []
+        for i in range(max(0, self.args.functions - 4), self.args.functions):
+            calls.append("f%d(%s)" % (i, ", ".join(str(self.rnd.randint(1, 9))
+                                                  for _ in range(self.arities[i]))))
+        self.emit(0, "int main()")
+        self.emit(0, "{")
+        self.emit(1, "return (%s) & 255;" % (" + ".join(calls) or "0"))
+        self.emit(0, "}")
+        return "\n".join(self.out) + "\n"
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--functions", type=int, default=10)
+    parser.add_argument("--depth", type=int, default=3,
+                        help="depth of every expression tree")
+    parser.add_argument("--stmts", type=int, default=10,
+                        help="statements per block")
+    parser.add_argument("--nest", type=int, default=2,
+                        help="while/if nesting inside a function")
+    parser.add_argument("--locals", type=int, default=4)
+    parser.add_argument("--trips", type=int, default=3,
+                        help="iterations of every loop")
+    parser.add_argument("--calls", type=float, default=0.05,
+                        help="chance that a leaf is a call")
+    parser.add_argument("--seed", type=int, default=1)
+    parser.add_argument("-o", dest="output", help="output file, default stdout")
+    args = parser.parse_args()
+
+    text = Generator(args).program()
+    if args.output:
+        with open(args.output, "w") as f:
+            f.write(text)
+    else:
+        sys.stdout.write(text)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,29 @@
+// bit manipulation: a xorshift generator and a shift and mask popcount
+int popcount(int x)
+{
+  int c;
+  c = 0;
+  while (x != 0) {
+    c = c + (x & 1);
+    x = x >> 1;
+  }
+  return c;
+}
+
+int main()
+{
+  int x;
+  int i;
+  int s;
+  x = 2463534;
+  s = 0;
+  i = 0;
+  while (i < 5000000) {
+    x = x ^ ((x & 262143) << 13);
+    x = x ^ (x >> 17);
+    x = x ^ ((x & 67108863) << 5);
+    s = s + popcount(x & 65535);
+    i = i + 1;
+  }
+  return s & 255;
+}
@@ -0,0 +1,12 @@
+// recursion: two calls per level, nothing to fold
+int fib(int n)
+{
+  if (n < 2)
+    return n;
+  return fib(n - 1) + fib(n - 2);
+}
+
+int main()
+{
+  return fib(35) & 255;
+}
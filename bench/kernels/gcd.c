@@ -0,0 +1,29 @@
+// division heavy: Euclid on every pair of a small grid
+int gcd(int a, int b)
+{
+  int t;
+  while (b != 0) {
+    t = a % b;
+    a = b;
+    b = t;
+  }
+  return a;
+}
+
+int main()
+{
+  int a;
+  int b;
+  int s;
+  s = 0;
+  a = 1;
+  while (a < 3000) {
+    b = 1;
+    while (b < 3000) {
+      s = s + gcd(a, b);
+      b = b + 1;
+    }
+    a = a + 1;
+  }
+  return s & 255;
+}
@@ -0,0 +1,20 @@
+// nested counted loops, a multiply-add body with loop invariant parts
+int main()
+{
+  int i;
+  int j;
+  int s;
+  int k;
+  s = 0;
+  k = 7;
+  i = 0;
+  while (i < 20000) {
+    j = 0;
+    while (j < 10000) {
+      s = (s + i * k + j * 3 + (k * 11 - 5)) & 65535;
+      j = j + 1;
+    }
+    i = i + 1;
+  }
+  return s & 255;
+}
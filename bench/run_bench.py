@@ -0,0 +1,150 @@
+#!/usr/bin/env python3
+"""Runtime benchmark: how fast is the code cc generates?
+
+Every kernel in bench/kernels is compiled by cc at each setting
+
+  raw         the IR of the unoptimized AST (--unoptimized)
+  precompute  optimized_ir.ll at -O0, inlining and precomputing only
+  O1 O2 O3    precomputing plus the LLVM pipeline of that level
+
+and by the reference C compilers found on PATH (clang, gcc) at -O0 and -O2.
+The IR of every cc setting goes through the same llc -O2, so only what cc
+did differs. The binaries run --reps times, the fastest run counts, and
+every setting must return what the first reference returns.
+
+Results go to <out>/runtime.csv and <out>/runtime.json, one row per kernel
+and setting, with the speedup over raw and the time relative to the best
+reference binary.
+"""
+
+import argparse
+import csv
+import json
+import os
+import shutil
+import subprocess
+import sys
+import tempfile
+import time
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+
+# name: (cc arguments, suffix of the file to run)
+SETTINGS = [
+    ("raw", ["--unoptimized"], ".unoptimized_ir.ll"),
+    ("precompute", [], ".ll"),
+    ("O1", ["-O1"], ".ll"),
+    ("O2", ["-O2"], ".ll"),
+    ("O3", ["-O3"], ".ll"),
+]
+
+
+def run(cmd):
+    proc = subprocess.run(cmd, stdout=subprocess.PIPE, stderr=subprocess.STDOUT,
+                          universal_newlines=True)
+    if proc.returncode != 0:
+        sys.exit("run_bench: %s failed:\n%s" % (" ".join(cmd), proc.stdout))
+
+
+def build_cc(args, kernel, setting, workdir):
+    """binary of one kernel at one cc setting"""
+    name, flags, suffix = setting
+    base = os.path.join(workdir, "%s.%s" % (kernel, name))
+    run([args.cc, "-o", base + ".ll"] + flags +
+        [os.path.join(args.kernels, kernel + ".c")])
+    run([args.llc, "-O2", "-filetype=obj", "-relocation-model=pic",
+         base + suffix, "-o", base + ".o"])
+    run([args.linker, base + ".o", "-o", base])
+    return base
+
+
+def build_ref(args, kernel, compiler, level, workdir):
+    base = os.path.join(workdir, "%s.%s-%s" % (kernel, os.path.basename(compiler), level))
+    run([compiler, "-" + level, "-w", os.path.join(args.kernels, kernel + ".c"),
+         "-o", base])
+    return base
+
+
+def measure(binary, reps):
+    """exit status and fastest wall time in ms"""
+    best, status = None, None
+    for _ in range(reps):
+        start = time.perf_counter()
+        status = subprocess.run([binary]).returncode
+        ms = (time.perf_counter() - start) * 1e3
+        best = ms if best is None or ms < best else best
+    return status, best
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--cc", default=os.path.join(HERE, "..", "cc"))
+    parser.add_argument("--kernels", default=os.path.join(HERE, "kernels"))
+    parser.add_argument("--out", default=os.path.join(HERE, "results"))
+    parser.add_argument("--kernel", action="append",
+                        help="run only these kernels (repeatable), default all")
+    parser.add_argument("--ref", action="append",
+                        help="reference compiler (repeatable), default clang and gcc")
+    parser.add_argument("--ref-level", action="append",
+                        help="reference optimization level (repeatable), default O0 and O2")
+    parser.add_argument("--llc", default="llc")
+    parser.add_argument("--reps", type=int, default=3)
+    args = parser.parse_args()
+
+    refs = [r for r in (args.ref or ["clang", "gcc"]) if shutil.which(r)]
+    if not refs:
+        sys.exit("run_bench: no reference compiler found, use --ref")
+    if not shutil.which(args.llc):
+        sys.exit("run_bench: %s not found, use --llc" % args.llc)
+    # the objects of llc are linked by the first reference compiler
+    args.linker = refs[0]
+    levels = args.ref_level or ["O0", "O2"]
+    kernels = args.kernel or sorted(f[:-2] for f in os.listdir(args.kernels)
+                                    if f.endswith(".c"))
+
+    os.makedirs(args.out, exist_ok=True)
+    rows = []
+    wrong = 0
+    with tempfile.TemporaryDirectory() as workdir:
+        for kernel in kernels:
+            builds = []
+            for compiler in refs:
+                for level in levels:
+                    builds.append(("%s -%s" % (compiler, level),
+                                   build_ref(args, kernel, compiler, level, workdir)))
+            for setting in SETTINGS:
+                builds.append(("cc " + setting[0],
+                               build_cc(args, kernel, setting, workdir)))
+
+            results = [(name,) + measure(binary, args.reps) for name, binary in builds]
+            expected = results[0][1]
+            raw_ms = [ms for name, _, ms in results if name == "cc raw"][0]
+            ref_ms = min(ms for name, _, ms in results if not name.startswith("cc "))
+            print("%s (returns %d)" % (kernel, expected))
+            for name, status, ms in results:
+                ok = status == expected
+                wrong += not ok
+                rows.append({"kernel": kernel, "setting": name, "status": status,
+                             "correct": ok, "ms": round(ms, 3),
+                             "speedup_vs_raw": round(raw_ms / ms, 2),
+                             "vs_best_ref": round(ms / ref_ms, 2)})
+                print("  %-14s %10.3f ms  %6.2fx raw  %6.2fx best ref%s" %
+                      (name, ms, raw_ms / ms, ms / ref_ms,
+                       "" if ok else "  WRONG, returned %d" % status))
+
+    fields = ["kernel", "setting", "status", "correct", "ms", "speedup_vs_raw",
+              "vs_best_ref"]
+    with open(os.path.join(args.out, "runtime.csv"), "w") as f:
+        writer = csv.DictWriter(f, fieldnames=fields)
+        writer.writeheader()
+        writer.writerows(rows)
+    with open(os.path.join(args.out, "runtime.json"), "w") as f:
+        json.dump({"cc": args.cc, "refs": refs, "ref_levels": levels,
+                   "reps": args.reps, "rows": rows}, f, indent=1)
+    print("results in %s/runtime.{csv,json}" % args.out)
+    if wrong:
+        sys.exit("run_bench: %d wrong results" % wrong)
+
+
+if __name__ == "__main__":
+    main()
@@ -2,20 +2,47 @@
 #include <cstdio>
 #include <iostream>
 #include "ast.hpp"
+#include "timing.hpp"
 
 using namespace std;
 using namespace ast;
 
-// stuff from flex that bison needs to know about:
-extern "C" int yylex();
-int yyparse();
-extern "C" FILE *yyin;
-
 void yyerror(const char *s);
 
 %}
-%code requires {#include "ast.hpp"}
+%code requires {
+#include "ast.hpp"
+#ifndef YY_TYPEDEF_YY_SCANNER_T
+#define YY_TYPEDEF_YY_SCANNER_T
+typedef void *yyscan_t;
+#endif
+}
+%code {
+// stuff from the reentrant flex scanner that bison needs to know about:
+int yylex(YYSTYPE *yylval_param, yyscan_t yyscanner);
+
+// the parser reaches the scanner through here, so that --time-report can
+// tell scanning and parsing apart
+static int timedLex(YYSTYPE *yylval_param, yyscan_t yyscanner) {
+  ast::TimeReport *report = ast::TimeReport::current();
+  if (report == NULL)
+    return yylex(yylval_param, yyscanner);
+  double start = ast::wallSeconds();
+  uint64_t allocs = ast::allocationCount();
+  uint64_t bytes = ast::allocatedBytes();
+  int token = yylex(yylval_param, yyscanner);
+  report->addLexing(ast::wallSeconds() - start, ast::allocationCount() - allocs,
+                    ast::allocatedBytes() - bytes);
+  return token;
+}
+#define yylex timedLex
+
+void yyerror(yyscan_t scanner, ast::Program **result, const char *s);
+}
 %define api.value.type {ast::Node *}
+%define api.pure full
+%lex-param {yyscan_t scanner}
+%parse-param {yyscan_t scanner} {ast::Program **result}
 %token	IDENTIFIER I_CONSTANT F_CONSTANT STRING_LITERAL FUNC_NAME SIZEOF
 %token	PTR_OP INC_OP DEC_OP LEFT_OP RIGHT_OP LE_OP GE_OP EQ_OP NE_OP
 %token	AND_OP OR_OP MUL_ASSIGN DIV_ASSIGN MOD_ASSIGN ADD_ASSIGN
@@ -78,7 +105,7 @@ postfix_expression
 	| postfix_expression '[' expression ']'
 	| postfix_expression '(' ')'
 	| postfix_expression '(' argument_expression_list ')' { 
-      string fxn_name = dynamic_cast<IdentifierList *>($1)->getString();
+      Symbol fxn_name = nodeCast<IdentifierList *>($1)->getSymbol();
       $$ = new FxnCall(fxn_name, $3);
     }
 	| postfix_expression '.' IDENTIFIER
@@ -91,7 +118,7 @@ postfix_expression
 
 argument_expression_list
 	: assignment_expression                                 {$$ = new ParameterList($1);}
-	| argument_expression_list ',' assignment_expression    {(dynamic_cast<ParameterList *>($1))->addNode($3); $$=$1;}
+	| argument_expression_list ',' assignment_expression    {(nodeCast<ParameterList *>($1))->addNode($3); $$=$1;}
 	;
 
 unary_expression
@@ -218,10 +245,10 @@ declaration
 declaration_specifiers
 	: storage_class_specifier declaration_specifiers
 	| storage_class_specifier
-	| type_specifier declaration_specifiers { int temp = (dynamic_cast<Temporary*>($2))->getTemp();
+	| type_specifier declaration_specifiers { int temp = (nodeCast<Temporary*>($2))->getTemp();
                                             if (temp == 0) {
                                               Attr a = _CONST;
-                                              (dynamic_cast<Type *>($1))->addAttr(a); 
+                                              (nodeCast<Type *>($1))->addAttr(a); 
                                               $$=$1;
                                             }
                                           }
@@ -352,8 +379,8 @@ alignment_specifier
 	;
 
 declarator
-	: pointer direct_declarator { int pcount = (dynamic_cast<Temporary*>($1))->getTemp();
-                                dynamic_cast<IdentifierList*>($2)->addPointerCount(pcount);
+	: pointer direct_declarator { int pcount = (nodeCast<Temporary*>($1))->getTemp();
+                                nodeCast<IdentifierList*>($2)->addPointerCount(pcount);
                                 $$ = $2;
                               }
 	| direct_declarator         {$$ = $1;}
@@ -372,12 +399,12 @@ direct_declarator
 	| direct_declarator '[' type_qualifier_list ']'
 	| direct_declarator '[' assignment_expression ']'
 	| direct_declarator '(' parameter_type_list ')' {
-      $$ = new FxnNameArg((dynamic_cast<IdentifierList *>($1))->getFxnName(),
-                          dynamic_cast<ParameterList *>($3));
+      $$ = new FxnNameArg((nodeCast<IdentifierList *>($1))->getSymbol(),
+                          nodeCast<ParameterList *>($3));
     }
 	| direct_declarator '(' ')'                 {
       vector<string> e;
-      $$ = new FxnNameArg((dynamic_cast<IdentifierList *>($1))->getFxnName(), new ParameterList());
+      $$ = new FxnNameArg((nodeCast<IdentifierList *>($1))->getSymbol(), new ParameterList());
     }
 	| direct_declarator '(' identifier_list ')'
 	;
@@ -385,7 +412,7 @@ direct_declarator
 pointer
 	: '*' type_qualifier_list pointer    
 	| '*' type_qualifier_list            
-	| '*' pointer                       { (dynamic_cast<Temporary *>($2))->add(1); $$=$2;}
+	| '*' pointer                       { (nodeCast<Temporary *>($2))->add(1); $$=$2;}
 	| '*'                               { $$ = new Temporary(1);}
 	;
 
@@ -401,12 +428,12 @@ parameter_type_list
 	;
 
 parameter_list
-	: parameter_declaration                       { $$ = new ParameterList(dynamic_cast<Declaration *>($1));}
-	| parameter_list ',' parameter_declaration    { (dynamic_cast<ParameterList*>($1))->addNode($3); $$ = $1;}
+	: parameter_declaration                       { $$ = new ParameterList(nodeCast<Declaration *>($1));}
+	| parameter_list ',' parameter_declaration    { (nodeCast<ParameterList*>($1))->addNode($3); $$ = $1;}
 	;
 
 parameter_declaration
-	: declaration_specifiers declarator           { $$ = new Declaration(dynamic_cast<Type *>($1), dynamic_cast<IdentifierList *>($2));}
+	: declaration_specifiers declarator           { $$ = new Declaration(nodeCast<Type *>($1), nodeCast<IdentifierList *>($2));}
 	| declaration_specifiers abstract_declarator
 	| declaration_specifiers
 	;
@@ -504,7 +531,7 @@ compound_statement
 
 block_item_list
 	: block_item                                {$$ = new Block($1);}
-	| block_item_list block_item                {(dynamic_cast<Block *>$1)->addNode($2); $$ = $1;}
+	| block_item_list block_item                {(nodeCast<Block *>($1))->addNode($2); $$ = $1;}
 	;
 
 block_item
@@ -541,11 +568,10 @@ jump_statement
 	;
 
 translation_unit                                              /* ------  ROOT  ------ */
-	: external_declaration                    {$$ = new Program($1); prog->addNode($1);}
+	: external_declaration                    {$$ = new Program($1); *result = nodeCast<Program *>($$);}
 	| translation_unit external_declaration   {
-      (dynamic_cast<Program *>($1))->addNode($2);
+      (nodeCast<Program *>($1))->addNode($2);
       $$ = $1;
-      prog->addNode($2);
     }
 	;
 
@@ -557,7 +583,7 @@ external_declaration
 function_definition
 	: declaration_specifiers declarator declaration_list compound_statement
 	| declaration_specifiers declarator compound_statement {
-      $$ = new FxnDef(dynamic_cast<Type *>($1), dynamic_cast<FxnNameArg *>($2), dynamic_cast<Block *>($3));
+      $$ = new FxnDef(nodeCast<Type *>($1), nodeCast<FxnNameArg *>($2), nodeCast<Block *>($3));
     }
 	;
 
@@ -574,3 +600,8 @@ void yyerror(const char *s)
 	fflush(stdout);
 	fprintf(stderr, "*** %s\n", s);
 }
+
+void yyerror(yyscan_t, ast::Program **, const char *s)
+{
+	yyerror(s);
+}
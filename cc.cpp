@@ -2,48 +2,311 @@
 #include <stdlib.h>
 #include <assert.h>
 #include "ast.hpp"
-#include "c.tab.hpp"
+#include "source_buffer.hpp"
+#include "timing.hpp"
 #include <iostream>
+#include <fstream>
+#include <vector>
+#include <string>
+#include <thread>
+#include <atomic>
 
 using namespace ast;
 using namespace std;
 
-extern "C" int yylex();
-int yyparse();
-extern "C" FILE *yyin;
-
 static void usage()
 {
-  printf("Usage: cc <prog.c>\n");
+  fprintf(stderr, "Usage: cc [-j N] [-O0|-O1|-O2|-O3] [--passes=p1,p2,...] "
+          "[--time-passes] [--emit=ll|bc|asm|obj] [--run] [--dump-ast] [--dump-ir] "
+          "[--unoptimized] [--time-report] [--trace-json=file] [-o out] <prog.c> [more.c ...] [@response-file]\n");
+}
+
+struct Options {
+  int jobs;     // threads for one file, or for the whole batch
+  bool dump_ast; // print both ASTs on stdout
+  bool dump_ir;  // echo both modules on stdout
+  string output; // optimized output of a single input, "" for the default
+  bool unoptimized;  // also write the IR of the unoptimized AST
+  bool time_report;  // phase table on stderr after every file
+  string trace_json; // Chrome trace of the whole run, "" for none
+  int opt_level;     // LLVM pipeline for optimized_ir.ll
+  string passes;     // explicit pass list instead of opt_level
+  bool time_passes;
+  EmitKind emit;     // format of the optimized output
+  bool run;          // JIT the optimized module and call main
+};
+
+// file extension for what --emit writes
+static string emitExtension(EmitKind emit)
+{
+  switch (emit) {
+    case _EMIT_BC:  return ".bc";
+    case _EMIT_ASM: return ".s";
+    case _EMIT_OBJ: return ".o";
+    default:        return ".ll";
+  }
+}
+
+// compile one translation unit, every node lives in the arena of this call
+static int compileFile(char const *filename, string unopt_out, string opt_out,
+                       Options &opts, int jobs)
+{
+  TimeReport report;
+  TimeReportScope report_scope(opts.time_report ? &report : NULL);
+  SpanScope file_span(filename, "file");
+  // interned identifiers point into the mapped source, it must die last
+  SourceBuffer source;
+  Interner names;
+  InternerScope names_scope(names);
+  Arena arena;
+  ArenaScope arena_scope(arena);
+
+  bool opened;
+  {
+    PhaseScope phase("read");
+    opened = source.open(filename);
+  }
+  if (!opened) {
+    fprintf(stderr, "cc: cannot open %s\n", filename);
+    return 1;
+  }
+  int ret;
+  Program *parsed;
+  {
+    PhaseScope phase("parse");
+    parsed = parseBuffer(source.getBase(), source.getScanSize(), &ret);
+  }
+  // not even one declaration, the error is already printed
+  if (parsed == NULL)
+    return ret;
+  if (opts.time_report) {
+    report.splitLexing();
+    report.setNodeCount(arena.getNodeCount());
+  }
+
+  // nothing goes to stdout unless asked for
+  if (opts.dump_ast || opts.dump_ir)
+    cout << "\n\n";
+  if (opts.dump_ast) {
+    cout << "--------------------- Un-optimized AST ---------------------\n";
+    printAST(parsed);
+  }
+  // the unoptimized IR stays exactly what the AST generates, it is a
+  // second codegen run and only made on request
+  IrOptions unopt_ir;
+  unopt_ir.jobs = jobs;
+  unopt_ir.echo = opts.dump_ir;
+  unopt_ir.stage = "unoptimized";
+  if (opts.unoptimized) {
+    if (opts.dump_ir)
+      cout << "--------------- LLVM IR of un-optimzed AST----------------------\n";
+    if (!dumpLLVMIr(parsed, unopt_out, unopt_ir))
+      ret = 1;
+  }
+
+  // helpers are expanded first so that their bodies fold at the call sites
+  Node *inlined;
+  {
+    PhaseScope phase("inline");
+    inlined = inlining(parsed);
+  }
+  Node *opt_prog;
+  {
+    PhaseScope phase("precompute");
+    opt_prog = precomputing(inlined);
+  }
+  if (opts.dump_ast) {
+    cout << "--------------------- Optimized AST ---------------------\n";
+    printAST(opt_prog);
+  }
+  if (opts.dump_ir)
+    cout << "--------------- LLVM IR of optimzed AST----------------------\n";
+  IrOptions opt_ir = unopt_ir;
+  opt_ir.opt_level = opts.opt_level;
+  opt_ir.passes = opts.passes;
+  opt_ir.time_passes = opts.time_passes;
+  opt_ir.emit = opts.emit;
+  opt_ir.stage = "optimized";
+  if (!dumpLLVMIr(opt_prog, opt_out, opt_ir))
+    ret = 1;
+
+  if (opts.run) {
+    int main_ret;
+    double seconds;
+    bool ran;
+    {
+      PhaseScope phase("run");
+      ran = runLLVMIr(&main_ret, &seconds);
+    }
+    if (ran)
+      printf("%s: main returned %d in %.3f ms\n", filename, main_ret, seconds * 1000);
+    else
+      ret = 1;
+  }
+
+  // the whole tree goes away with the arena, the module goes here
+  releaseLLVMIr();
+  if (opts.time_report)
+    report.print(stderr, filename);
+  return ret;
+}
+
+// foo/bar.c -> foo/bar<suffix>
+static string outputName(string input, string suffix)
+{
+  size_t dot = input.rfind('.');
+  size_t slash = input.rfind('/');
+  if (dot != string::npos && (slash == string::npos || dot > slash))
+    input = input.substr(0, dot);
+  return input + suffix;
+}
+
+// compile every input on a pool of opts.jobs threads, one file per task
+static int compileBatch(vector<string> &inputs, Options &opts)
+{
+  int size = inputs.size();
+  vector<int> rets(size, 0);
+  atomic<int> next(0);
+  vector<thread> workers;
+  // pass timers, cpu time and allocation counts are process wide, timed
+  // batches run one file at a time
+  bool timed = opts.time_passes || opts.time_report;
+  int nthreads = timed ? 1 : min(opts.jobs, size);
+  for (int t=0; t<nthreads; ++t) {
+    workers.push_back(thread([&]() {
+      for (int i = next++; i < size; i = next++)
+        rets[i] = compileFile(inputs[i].c_str(),
+                              outputName(inputs[i], ".unoptimized_ir.ll"),
+                              outputName(inputs[i], ".optimized_ir" + emitExtension(opts.emit)),
+                              opts, 1);
+    }));
+  }
+  for (int t=0; t<nthreads; ++t)
+    workers[t].join();
+
+  // only the files that failed are reported
+  int failed = 0;
+  for (int i=0; i<size; ++i) {
+    if (rets[i] != 0) {
+      fprintf(stderr, "%s: retv = %d\n", inputs[i].c_str(), rets[i]);
+      ++failed;
+    }
+  }
+  return failed;
+}
+
+// @file lists more inputs, separated by white space
+static bool readResponseFile(char const *path, vector<string> &inputs)
+{
+  ifstream in(path);
+  if (!in) {
+    fprintf(stderr, "cc: cannot open response file %s\n", path);
+    return false;
+  }
+  string name;
+  while (in >> name)
+    inputs.push_back(name);
+  return true;
 }
 
 int
 main(int argc, char **argv)
 {
-  if (argc != 2) {
+  Options opts;
+  opts.jobs = 1;
+  opts.dump_ast = false;
+  opts.dump_ir = false;
+  opts.unoptimized = false;
+  opts.time_report = false;
+  opts.opt_level = 0;
+  opts.time_passes = false;
+  opts.emit = _EMIT_LL;
+  opts.run = false;
+  vector<string> inputs;
+  for (int i=1; i<argc; ++i) {
+    string arg = argv[i];
+    if (arg == "-j" && i+1 < argc)
+      opts.jobs = atoi(argv[++i]);
+    else if (arg.size() > 2 && arg.substr(0, 2) == "-j")
+      opts.jobs = atoi(arg.c_str() + 2);
+    else if (arg.size() == 3 && arg.substr(0, 2) == "-O" && arg[2] >= '0' && arg[2] <= '3')
+      opts.opt_level = arg[2] - '0';
+    else if (arg.substr(0, 9) == "--passes=") {
+      opts.passes = arg.substr(9);
+      if (!checkPassList(opts.passes))
+        exit(1);
+    }
+    else if (arg == "--time-passes")
+      opts.time_passes = true;
+    else if (arg == "--emit=ll")
+      opts.emit = _EMIT_LL;
+    else if (arg == "--emit=bc")
+      opts.emit = _EMIT_BC;
+    else if (arg == "--emit=asm")
+      opts.emit = _EMIT_ASM;
+    else if (arg == "--emit=obj")
+      opts.emit = _EMIT_OBJ;
+    else if (arg == "--run")
+      opts.run = true;
+    else if (arg == "--dump-ast")
+      opts.dump_ast = true;
+    else if (arg == "--dump-ir")
+      opts.dump_ir = true;
+    else if (arg == "--unoptimized")
+      opts.unoptimized = true;
+    else if (arg == "--time-report")
+      opts.time_report = true;
+    else if (arg.substr(0, 13) == "--trace-json=")
+      opts.trace_json = arg.substr(13);
+    else if (arg == "-o" && i+1 < argc)
+      opts.output = argv[++i];
+    else if (arg[0] == '@') {
+      if (!readResponseFile(argv[i] + 1, inputs))
+        exit(1);
+    }
+    else if (arg[0] == '-') {
+      usage();
+      exit(1);
+    }
+    else
+      inputs.push_back(arg);
+  }
+  if (inputs.empty() || opts.jobs < 1) {
     usage();
     exit(1);
   }
-  char const *filename = argv[1];
-  yyin = fopen(filename, "r");
-  assert(yyin);
-  int ret = yyparse();
-
-  cout << endl << endl;
-  // Printing the ast
-  cout << "--------------------- Un-optimized AST ---------------------\n";
-  printAST(prog);
-  cout << "--------------- LLVM IR of un-optimzed AST----------------------\n";
-  dumpLLVMIr(prog, "unoptimized_ir.ll");
-  
-  cout << "--------------------- Optimized AST ---------------------\n";
-  Node *opt_prog = precomputing(prog);
-  printAST(opt_prog);
-  cout << "--------------- LLVM IR of optimzed AST----------------------\n";
-  dumpLLVMIr(opt_prog, "optimized_ir.ll");
-
-
-  cout << endl << endl;
-  printf("retv = %d\n", ret);
-  exit(0);
+  if (inputs.size() > 1 && !opts.output.empty()) {
+    fprintf(stderr, "cc: -o needs a single input file\n");
+    exit(1);
+  }
+
+  // both are switched on before any thread starts
+  countAllocations(opts.time_report);
+  TraceLog trace;
+  if (!opts.trace_json.empty())
+    TraceLog::setGlobal(&trace);
+
+  if (inputs.size() > 1) {
+    // several files share one process and one pool, output goes to files only
+    opts.dump_ast = opts.dump_ir = false;
+    int failed = compileBatch(inputs, opts);
+    if (!opts.trace_json.empty() && !trace.write(opts.trace_json))
+      failed = 1;
+    exit(failed == 0 ? 0 : 1);
+  }
+
+  // -o foo.ll writes foo.ll and foo.unoptimized_ir.ll
+  string opt_out = "optimized_ir" + emitExtension(opts.emit);
+  string unopt_out = "unoptimized_ir.ll";
+  if (!opts.output.empty()) {
+    opt_out = opts.output;
+    unopt_out = outputName(opts.output, ".unoptimized_ir.ll");
+  }
+  int ret = compileFile(inputs[0].c_str(), unopt_out, opt_out, opts, opts.jobs);
+
+  if (opts.dump_ast || opts.dump_ir)
+    printf("\n\nretv = %d\n", ret);
+  if (!opts.trace_json.empty() && !trace.write(opts.trace_json))
+    ret = 1;
+  exit(ret == 0 ? 0 : 1);
 }
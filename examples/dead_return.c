@@ -0,0 +1,27 @@
+// Branches that fold away leave a return in the middle of a block,
+// nothing after it may be generated.
+int literal(int x)
+{
+  if (1) {
+    return x + 1;
+  }
+  return 2;
+}
+
+int propagated(int x)
+{
+  int debug;
+  debug = 0;
+  if (debug == 0) {
+    return x * 2;
+  }
+  else {
+    x = x + 5;
+  }
+  return x;
+}
+
+int main()
+{
+  return literal(4) + propagated(3);
+}
@@ -0,0 +1,80 @@
+#include "source_buffer.hpp"
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <cstdlib>
+#include <cstring>
+
+namespace ast {
+
+bool SourceBuffer::open(const char *path) {
+  close();
+  int fd = ::open(path, O_RDONLY);
+  if (fd < 0) return false;
+  struct stat st;
+  if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+    bool ok = readAll(fd);
+    ::close(fd);
+    return ok;
+  }
+
+  size = st.st_size;
+  size_t page = sysconf(_SC_PAGESIZE);
+  mapped_size = (size + 2 + page - 1) / page * page;
+  // reserve zeroed memory for contents + terminators, then map the file over
+  // its start. The tail of the last file page reads as zero, as do the
+  // anonymous pages after it, so both terminators are already in place.
+  void *region = mmap(NULL, mapped_size, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (region == MAP_FAILED) {
+    mapped_size = 0;
+    bool ok = readAll(fd);
+    ::close(fd);
+    return ok;
+  }
+  if (size > 0 && mmap(region, size, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED) {
+    munmap(region, mapped_size);
+    mapped_size = 0;
+    bool ok = readAll(fd);
+    ::close(fd);
+    return ok;
+  }
+  ::close(fd);
+  base = static_cast<char *>(region);
+  return true;
+}
+
+// slow path for anything that can not be mapped
+bool SourceBuffer::readAll(int fd) {
+  size_t capacity = 64 * 1024;
+  size = 0;
+  base = static_cast<char *>(malloc(capacity));
+  for (;;) {
+    // room for at least one byte besides the terminators, a read of 0 is EOF
+    if (size + 2 >= capacity) {
+      capacity *= 2;
+      base = static_cast<char *>(realloc(base, capacity));
+    }
+    ssize_t n = read(fd, base + size, capacity - size - 2);
+    if (n < 0) { close(); return false;}
+    if (n == 0) break;
+    size += n;
+  }
+  base[size] = base[size+1] = '\0';
+  return true;
+}
+
+void SourceBuffer::close() {
+  if (base != NULL) {
+    if (mapped_size != 0)
+      munmap(base, mapped_size);
+    else
+      free(base);
+  }
+  base = NULL;
+  size = mapped_size = 0;
+}
+
+} // namespace ast end
@@ -0,0 +1,39 @@
+#ifndef CC_SOURCE_BUFFER_HPP
+#define CC_SOURCE_BUFFER_HPP
+
+#include <cstddef>
+
+namespace ast {
+
+// A source file mapped into memory and followed by two '\0' bytes, which is
+// the layout flex's yy_scan_buffer scans in place. Pages are private
+// copy-on-write, so the scanner's temporary writes never reach the file.
+// flex puts a '\0' after every token, so each page is still copied once on
+// its first write. What the mapping saves is the stdio buffer and a copy
+// of every token, identifiers and strings stay views into these pages.
+// Falls back to reading the file when it can not be mapped (pipes, ...).
+class SourceBuffer {
+ public:
+  SourceBuffer() : base(NULL), size(0), mapped_size(0) {}
+  ~SourceBuffer() { close();}
+  bool open(const char *path);
+  void close();
+
+  // file contents followed by the two terminators
+  char *getBase() { return base;}
+  // bytes to hand to the scanner, contents + 2
+  size_t getScanSize() { return size + 2;}
+  size_t getSize() { return size;}
+ private:
+  SourceBuffer(const SourceBuffer &);
+  SourceBuffer &operator=(const SourceBuffer &);
+  bool readAll(int fd);
+
+  char *base;
+  size_t size;
+  size_t mapped_size; // 0 when base was read into the heap
+};
+
+} // ast namespace end
+
+#endif // CC_SOURCE_BUFFER_HPP
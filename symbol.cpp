@@ -0,0 +1,63 @@
+#include "symbol.hpp"
+#include "ast.hpp"
+
+namespace ast {
+static thread_local Interner *curr_interner = NULL;
+
+Interner *Interner::current() {
+  if (curr_interner == NULL) {
+    // fallback for names interned outside of any compilation
+    static thread_local Interner default_interner;
+    return &default_interner;
+  }
+  return curr_interner;
+}
+
+void Interner::setCurrent(Interner *i) { curr_interner = i;}
+
+// FNV-1a
+static uint32_t hashName(StringRef s) {
+  uint32_t h = 2166136261u;
+  for (size_t i=0; i<s.size(); ++i) {
+    h ^= (unsigned char)s[i];
+    h *= 16777619u;
+  }
+  return h;
+}
+
+Interner::Interner() : storage(new Arena(16 * 1024)) {
+  slots.resize(256, 0);
+}
+
+Interner::~Interner() { delete storage;}
+
+Symbol Interner::intern(StringRef s, bool copy) {
+  uint32_t h = hashName(s);
+  size_t mask = slots.size() - 1;
+  size_t i = h & mask;
+  for (; slots[i] != 0; i = (i + 1) & mask) {
+    Symbol id = slots[i] - 1;
+    if (hashes[id] == h && names[id] == s)
+      return id;
+  }
+  Symbol id = names.size();
+  names.push_back(copy ? storage->copyString(s) : s);
+  hashes.push_back(h);
+  slots[i] = id + 1;
+  if (names.size() * 2 > slots.size())
+    grow();
+  return id;
+}
+
+void Interner::grow() {
+  slots.assign(slots.size() * 2, 0);
+  size_t mask = slots.size() - 1;
+  for (Symbol id=0; id<names.size(); ++id) {
+    size_t i = hashes[id] & mask;
+    while (slots[i] != 0)
+      i = (i + 1) & mask;
+    slots[i] = id + 1;
+  }
+}
+
+} // ast namespace end
@@ -0,0 +1,145 @@
+#ifndef CC_SYMBOL_HPP
+#define CC_SYMBOL_HPP
+
+#include <stdint.h>
+#include <vector>
+#include "llvm/ADT/StringRef.h"
+namespace ast {
+
+class Arena;
+
+// small integer standing for an interned identifier
+typedef uint32_t Symbol;
+
+// Maps every distinct identifier of a compilation to a Symbol, the lexer
+// interns while scanning so the rest of the compiler compares integers.
+// Open addressing with linear probing, names are stored once.
+class Interner {
+ public:
+  Interner();
+  ~Interner();
+  // copy = false keeps a view, the text must outlive the interner
+  Symbol intern(llvm::StringRef s, bool copy = true);
+  llvm::StringRef str(Symbol id) { return names[id];}
+  size_t size() { return names.size();}
+
+  // interner used by the lexer and the AST on this thread
+  static Interner *current();
+  static void setCurrent(Interner *i);
+ private:
+  Interner(const Interner &);
+  Interner &operator=(const Interner &);
+  void grow();
+
+  std::vector<uint32_t> slots; // Symbol + 1, 0 marks an empty slot
+  std::vector<uint32_t> hashes; // by Symbol
+  std::vector<llvm::StringRef> names;
+  Arena *storage;
+};
+
+// makes an interner current for the lifetime of the scope
+class InternerScope {
+ public:
+  InternerScope(Interner &i) : prev(Interner::current()) { Interner::setCurrent(&i);}
+  ~InternerScope() { Interner::setCurrent(prev);}
+ private:
+  Interner *prev;
+};
+
+// Symbol -> V with nested scopes.
+// One open addressing table holds the innermost binding of every symbol,
+// pushScope/popScope keep an undo log so leaving a scope restores whatever
+// the inner bindings shadowed. Lookups never allocate.
+template <typename V>
+class ScopedSymbolTable {
+ public:
+  ScopedSymbolTable() : used(0), shift(28) { slots.resize(16);}
+
+  void pushScope() { marks.push_back(undo.size());}
+  void popScope() {
+    size_t mark = marks.back();
+    marks.pop_back();
+    while (undo.size() > mark) {
+      Undo &u = undo.back();
+      Slot &s = slots[find(u.key)];
+      s.live = u.was_live;
+      s.value = u.old_value;
+      undo.pop_back();
+    }
+  }
+
+  void insert(Symbol key, V value) {
+    if ((used + 1) * 2 > slots.size())
+      grow();
+    size_t i = find(key);
+    Slot &s = slots[i];
+    if (!s.full) {
+      s.full = true;
+      s.key = key;
+      s.live = false;
+      ++used;
+    }
+    if (!marks.empty()) {
+      Undo u = {key, s.live, s.value};
+      undo.push_back(u);
+    }
+    s.live = true;
+    s.value = value;
+  }
+
+  // NULL if key is not bound in any open scope
+  V *lookup(Symbol key) {
+    Slot &s = slots[find(key)];
+    return (s.full && s.live) ? &s.value : NULL;
+  }
+
+  void clear() {
+    slots.assign(16, Slot());
+    used = 0;
+    shift = 28;
+    undo.clear();
+    marks.clear();
+  }
+ private:
+  struct Slot {
+    Slot() : full(false), live(false), key(0), value() {}
+    bool full;  // key is set, the slot is never emptied again
+    bool live;  // key is currently bound
+    Symbol key;
+    V value;
+  };
+  struct Undo {
+    Symbol key;
+    bool was_live;
+    V old_value;
+  };
+
+  // slot holding key, or the empty slot where it belongs
+  size_t find(Symbol key) {
+    size_t mask = slots.size() - 1;
+    size_t i = (uint32_t)(key * 0x9E3779B1u) >> shift;
+    while (slots[i].full && slots[i].key != key)
+      i = (i + 1) & mask;
+    return i;
+  }
+
+  void grow() {
+    std::vector<Slot> old;
+    old.swap(slots);
+    slots.resize(old.size() * 2);
+    --shift;
+    for (size_t i=0; i<old.size(); ++i)
+      if (old[i].full)
+        slots[find(old[i].key)] = old[i];
+  }
+
+  std::vector<Slot> slots;
+  size_t used;
+  unsigned shift; // 32 - log2(slots.size())
+  std::vector<Undo> undo;
+  std::vector<size_t> marks;
+};
+
+} // ast namespace end
+
+#endif // CC_SYMBOL_HPP
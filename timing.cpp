@@ -0,0 +1,206 @@
+#include "timing.hpp"
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <new>
+#include <time.h>
+#include <sys/resource.h>
+
+// Replacements of the global allocation functions, so that the allocations
+// of LLVM are counted as well. The counters are only touched when counting
+// is on, the plain flag is set before any thread starts.
+static bool counting = false;
+static std::atomic<uint64_t> alloc_count(0);
+static std::atomic<uint64_t> alloc_bytes(0);
+
+void *operator new(size_t size) {
+  if (counting) {
+    alloc_count.fetch_add(1, std::memory_order_relaxed);
+    alloc_bytes.fetch_add(size, std::memory_order_relaxed);
+  }
+  if (size == 0) size = 1;
+  for (;;) {
+    if (void *p = malloc(size))
+      return p;
+    // built without exceptions, there is no bad_alloc to throw
+    std::new_handler handler = std::get_new_handler();
+    if (handler == NULL) abort();
+    handler();
+  }
+}
+
+void *operator new(size_t size, const std::nothrow_t &) noexcept {
+  if (counting) {
+    alloc_count.fetch_add(1, std::memory_order_relaxed);
+    alloc_bytes.fetch_add(size, std::memory_order_relaxed);
+  }
+  return malloc(size == 0 ? 1 : size);
+}
+
+void *operator new[](size_t size) { return operator new(size);}
+void *operator new[](size_t size, const std::nothrow_t &t) noexcept { return operator new(size, t);}
+void operator delete(void *p) noexcept { free(p);}
+void operator delete[](void *p) noexcept { free(p);}
+void operator delete(void *p, size_t) noexcept { free(p);}
+void operator delete[](void *p, size_t) noexcept { free(p);}
+void operator delete(void *p, const std::nothrow_t &) noexcept { free(p);}
+void operator delete[](void *p, const std::nothrow_t &) noexcept { free(p);}
+
+namespace ast {
+
+void countAllocations(bool on) { counting = on;}
+uint64_t allocationCount() { return alloc_count.load(std::memory_order_relaxed);}
+uint64_t allocatedBytes() { return alloc_bytes.load(std::memory_order_relaxed);}
+
+double wallSeconds() {
+  return std::chrono::duration<double>(
+           std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+Usage Usage::now() {
+  Usage u;
+  u.wall = wallSeconds();
+  struct timespec ts;
+  clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+  u.cpu = ts.tv_sec + ts.tv_nsec * 1e-9;
+  struct rusage ru;
+  getrusage(RUSAGE_SELF, &ru);
+  u.peak_rss = ru.ru_maxrss;
+  u.allocs = allocationCount();
+  u.alloc_bytes = allocatedBytes();
+  return u;
+}
+
+static thread_local TimeReport *curr_report = NULL;
+
+TimeReport *TimeReport::current() { return curr_report;}
+void TimeReport::setCurrent(TimeReport *r) { curr_report = r;}
+
+void TimeReport::add(const std::string &name, const Usage &start, const Usage &end) {
+  Phase p;
+  p.name = name;
+  p.wall = end.wall - start.wall;
+  p.cpu = end.cpu - start.cpu;
+  p.peak_rss = end.peak_rss;
+  p.allocs = end.allocs - start.allocs;
+  p.alloc_bytes = end.alloc_bytes - start.alloc_bytes;
+  phases.push_back(p);
+}
+
+void TimeReport::splitLexing() {
+  if (phases.empty()) return;
+  Phase parse = phases.back();
+  Phase lex = parse;
+  lex.name = "lex (" + std::to_string(lex_tokens) + " tokens)";
+  lex.wall = lex_wall;
+  // the scanner does not wait for anything, its cpu time is its wall time
+  lex.cpu = lex_wall < parse.cpu ? lex_wall : parse.cpu;
+  lex.allocs = lex_allocs;
+  lex.alloc_bytes = lex_bytes;
+  parse.wall -= lex.wall;
+  parse.cpu -= lex.cpu;
+  parse.allocs -= lex.allocs;
+  parse.alloc_bytes -= lex.alloc_bytes;
+  phases.back() = lex;
+  phases.push_back(parse);
+  lex_wall = 0;
+  lex_allocs = lex_bytes = lex_tokens = 0;
+}
+
+void TimeReport::print(FILE *out, const char *title) {
+  fprintf(out, "===%s===\n", std::string(66, '-').c_str());
+  fprintf(out, "  cc time report: %s\n", title);
+  fprintf(out, "===%s===\n", std::string(66, '-').c_str());
+  fprintf(out, "  %-28s %10s %10s %12s %10s %10s\n",
+          "phase", "wall ms", "cpu ms", "peak RSS KB", "allocs", "alloc KB");
+  Phase total = {"total", 0, 0, 0, 0, 0};
+  for (size_t i=0; i<phases.size(); ++i) {
+    Phase &p = phases[i];
+    fprintf(out, "  %-28s %10.3f %10.3f %12ld %10llu %10.1f\n", p.name.c_str(),
+            p.wall * 1e3, p.cpu * 1e3, p.peak_rss, (unsigned long long)p.allocs,
+            p.alloc_bytes / 1024.0);
+    total.wall += p.wall;
+    total.cpu += p.cpu;
+    total.peak_rss = p.peak_rss > total.peak_rss ? p.peak_rss : total.peak_rss;
+    total.allocs += p.allocs;
+    total.alloc_bytes += p.alloc_bytes;
+  }
+  fprintf(out, "  %-28s %10.3f %10.3f %12ld %10llu %10.1f\n", total.name.c_str(),
+          total.wall * 1e3, total.cpu * 1e3, total.peak_rss,
+          (unsigned long long)total.allocs, total.alloc_bytes / 1024.0);
+  fprintf(out, "  AST nodes: %zu\n", nodes);
+}
+
+static TraceLog *global_trace = NULL;
+
+TraceLog *TraceLog::global() { return global_trace;}
+void TraceLog::setGlobal(TraceLog *t) { global_trace = t;}
+
+// small stable number per thread for the tid field
+static int traceThreadId() {
+  static std::atomic<int> next(1);
+  static thread_local int id = next++;
+  return id;
+}
+
+void TraceLog::add(llvm::StringRef name, const char *category, double begin, double end) {
+  Event e = {name.str(), category, begin, end, traceThreadId()};
+  std::lock_guard<std::mutex> guard(lock);
+  events.push_back(e);
+}
+
+static void writeJsonString(FILE *out, const std::string &s) {
+  fputc('"', out);
+  for (size_t i=0; i<s.size(); ++i) {
+    unsigned char c = s[i];
+    if (c == '"' || c == '\\')
+      fprintf(out, "\\%c", c);
+    else if (c < 0x20)
+      fprintf(out, "\\u%04x", c);
+    else
+      fputc(c, out);
+  }
+  fputc('"', out);
+}
+
+// complete ("X") events, timestamps in microseconds since the log started
+bool TraceLog::write(const std::string &path) {
+  FILE *out = fopen(path.c_str(), "w");
+  if (out == NULL) {
+    fprintf(stderr, "cc: cannot write %s\n", path.c_str());
+    return false;
+  }
+  std::lock_guard<std::mutex> guard(lock);
+  fprintf(out, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+  for (size_t i=0; i<events.size(); ++i) {
+    Event &e = events[i];
+    fprintf(out, "  {\"name\": ");
+    writeJsonString(out, e.name);
+    fprintf(out, ", \"cat\": \"%s\", \"ph\": \"X\", \"ts\": %.3f, \"dur\": %.3f, "
+            "\"pid\": 1, \"tid\": %d}%s\n", e.category, (e.begin - start) * 1e6,
+            (e.end - e.begin) * 1e6, e.tid, i + 1 < events.size() ? "," : "");
+  }
+  fprintf(out, "]}\n");
+  bool ok = !ferror(out);
+  if (fclose(out) != 0) ok = false;
+  if (!ok)
+    fprintf(stderr, "cc: error writing %s\n", path.c_str());
+  return ok;
+}
+
+void PhaseScope::begin(const char *phase, llvm::StringRef detail) {
+  name = phase;
+  if (!detail.empty())
+    name += " (" + detail.str() + ")";
+  start = Usage::now();
+}
+
+void PhaseScope::end() {
+  Usage stop = Usage::now();
+  if (report != NULL)
+    report->add(name, start, stop);
+  if (trace != NULL)
+    trace->add(name, "phase", start.wall, stop.wall);
+}
+
+} // ast namespace end
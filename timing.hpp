@@ -0,0 +1,142 @@
+#ifndef CC_TIMING_HPP
+#define CC_TIMING_HPP
+
+#include <stdint.h>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <mutex>
+#include "llvm/ADT/StringRef.h"
+
+namespace ast {
+
+// Heap allocations of the whole process, counted by the global operator new
+// in timing.cpp once counting is switched on (it stays off unless asked).
+void countAllocations(bool on);
+uint64_t allocationCount();
+uint64_t allocatedBytes();
+
+// seconds on a monotonic clock
+double wallSeconds();
+
+// what the process has used up to now
+struct Usage {
+  double wall;
+  double cpu;          // seconds, all threads
+  long peak_rss;       // KB
+  uint64_t allocs;
+  uint64_t alloc_bytes;
+  static Usage now();
+};
+
+// -ftime-report style table of the phases of one compilation
+class TimeReport {
+ public:
+  TimeReport() : nodes(0), lex_wall(0), lex_allocs(0), lex_bytes(0), lex_tokens(0) {}
+  void add(const std::string &name, const Usage &start, const Usage &end);
+  // time the parser spent in the scanner (see c.y)
+  void addLexing(double wall, uint64_t allocs, uint64_t bytes) {
+    lex_wall += wall;
+    lex_allocs += allocs;
+    lex_bytes += bytes;
+    ++lex_tokens;
+  }
+  // move the scanner's share of the last phase into a phase of its own
+  void splitLexing();
+  void print(FILE *out, const char *title);
+  // size of the parsed AST, printed under the table
+  void setNodeCount(size_t n) { nodes = n;}
+
+  // report of the compilation running on this thread, NULL when not timed
+  static TimeReport *current();
+  static void setCurrent(TimeReport *r);
+ private:
+  struct Phase {
+    std::string name;
+    double wall, cpu;
+    long peak_rss;
+    uint64_t allocs, alloc_bytes;
+  };
+  std::vector<Phase> phases;
+  size_t nodes;
+  double lex_wall;
+  uint64_t lex_allocs, lex_bytes, lex_tokens;
+};
+
+// makes a report current for the lifetime of the scope, NULL for none
+class TimeReportScope {
+ public:
+  TimeReportScope(TimeReport *r) : prev(TimeReport::current()) { TimeReport::setCurrent(r);}
+  ~TimeReportScope() { TimeReport::setCurrent(prev);}
+ private:
+  TimeReport *prev;
+};
+
+// Chrome trace-event JSON (chrome://tracing, Perfetto) of the whole process.
+// Spans may be added from any thread.
+class TraceLog {
+ public:
+  TraceLog() : start(wallSeconds()) {}
+  void add(llvm::StringRef name, const char *category, double begin, double end);
+  bool write(const std::string &path);
+
+  // log of the process, NULL when not tracing. Set before threads start.
+  static TraceLog *global();
+  static void setGlobal(TraceLog *t);
+ private:
+  struct Event {
+    std::string name;
+    const char *category;
+    double begin, end;
+    int tid;
+  };
+  double start;
+  std::mutex lock;
+  std::vector<Event> events;
+};
+
+// Times the enclosing scope as one phase of the current report and one span
+// of the trace. Only a pointer test when neither is on.
+class PhaseScope {
+ public:
+  PhaseScope(const char *name, llvm::StringRef detail = llvm::StringRef())
+    : report(TimeReport::current()), trace(TraceLog::global()) {
+    if (report != NULL || trace != NULL) begin(name, detail);
+  }
+  ~PhaseScope() {
+    if (report != NULL || trace != NULL) end();
+  }
+ private:
+  PhaseScope(const PhaseScope &);
+  PhaseScope &operator=(const PhaseScope &);
+  void begin(const char *name, llvm::StringRef detail);
+  void end();
+
+  TimeReport *report;
+  TraceLog *trace;
+  std::string name;
+  Usage start;
+};
+
+// a span of the trace only, one function in codegen, one file of a batch
+class SpanScope {
+ public:
+  SpanScope(llvm::StringRef name, const char *category)
+    : trace(TraceLog::global()), name(name), category(category) {
+    if (trace != NULL) start = wallSeconds();
+  }
+  ~SpanScope() {
+    if (trace != NULL) trace->add(name, category, start, wallSeconds());
+  }
+ private:
+  SpanScope(const SpanScope &);
+  SpanScope &operator=(const SpanScope &);
+  TraceLog *trace;
+  llvm::StringRef name;
+  const char *category;
+  double start;
+};
+
+} // ast namespace end
+
+#endif // CC_TIMING_HPP